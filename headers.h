@@ -14,6 +14,7 @@
 #include "cvec4t.h"
 #include "hmatrix.h"
 
+typedef CVec2T<float> Vec2f;
 typedef CVec3T<float> Vec3f;
 typedef CVec4T<float> Vec4f;
 
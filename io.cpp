@@ -11,14 +11,111 @@ namespace View {
   static HMatrix<float> ExaminerRotation;
 };
 
+// heavy edits, run by Draw::worker on a copy of the mesh
+namespace {
+
+  // how often Input::Poll() looks for results, in milliseconds
+  const int POLL_MS = 100;
+
+  void triangulate(MeshObj& m) {
+    m.convert_to_triangles();
+    if( !m.validate() ) 
+      throw "Input::Keyboard(): all faces split broke mesh.";    
+  }
+
+  void loop_subdivide(MeshObj& m) {
+    m.convert_to_triangles();
+    if( !m.validate() ) 
+      throw "Input::Keyboard(): all faces split (for Loop subdivision) "
+	"broke mesh.";
+    m.subdivide_faces();
+    if( !m.validate() ) 
+      throw "Input::Keyboard(): Loop subdivision broke mesh.";   
+  }
+
+  void catmull_clark(MeshObj& m) {
+    m.subdivide_catmull_clark();
+    if( !m.validate() ) 
+      throw "Input::Keyboard(): Catmull-Clark subdivision broke mesh.";
+  }
+
+  void decimate_half(MeshObj& m) {
+    m.convert_to_triangles();
+    m.decimate(m.faces().size() / 2);
+    if( !m.validate() ) 
+      throw "Input::Keyboard(): decimation broke mesh.";
+  }
+
+  void remesh(MeshObj& m) {
+    m.convert_to_triangles();
+    m.remesh(m.mean_edge_length());
+    if( !m.validate() ) 
+      throw "Input::Keyboard(): remeshing broke mesh.";
+  }
+
+  // deletes the components with less than 1% of the faces of the largest
+  void strip_debris(MeshObj& m) {
+    std::vector<int> face_ids, vert_ids;
+    std::vector<MeshObj::Component> stats;
+    int n = m.label_components(face_ids, vert_ids, stats);
+    unsigned int largest = 0;
+    for( int i = 0; i < n; i++ ) largest = std::max(largest, stats[i].faces);
+    m.remove_small_components(largest / 100);
+    if( !m.validate() ) 
+      throw "Input::Keyboard(): removing components broke mesh.";
+  }
+
+  void fill_holes(MeshObj& m) {
+    m.fill_holes();
+    if( !m.validate() ) 
+      throw "Input::Keyboard(): hole filling broke mesh.";
+  }
+
+  // adds the faces with the given ids to the selection
+  void select(const std::set<uint32_t>& ids) {
+    Input::selected_faces.resize(Draw::mesh.faces().size(), false);
+    int k = 0;
+    for( list<Face*>::const_iterator f = Draw::mesh.faces().begin();
+	 f != Draw::mesh.faces().end(); f++, k++ )
+      if( ids.count(Draw::mesh.face_to_color(*f)) ) Input::selected_faces[k] = true;
+  }
+
+  std::set<uint32_t> selected_colors(void) {
+    std::set<uint32_t> colors;
+    int k = 0;
+    for( list<Face*>::const_iterator f = Draw::mesh.faces().begin();
+	 f != Draw::mesh.faces().end() && k < (int)Input::selected_faces.size();
+	 f++, k++ )
+      if( Input::selected_faces[k] ) colors.insert(Draw::mesh.face_to_color(*f));
+    return colors;
+  }
+
+  // the keys of the edits made here rather than by the worker
+  bool edits_mesh(unsigned char key) {
+    return key == 'x' || key == 'd' || key == 'z' || key == 'y';
+  }
+
+  void run_in_background(const char* name, MeshWorker::Operation op) {
+    bool idle = !Draw::worker.busy();
+    Draw::worker.submit(Draw::mesh, name, op);
+    if( idle ) glutTimerFunc(POLL_MS, Input::Poll, 0);
+  }
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 // STATIC VARIABLES  
 
 uint32_t Input::selected_face_color(0);
-Face* Input::selected_face = NULL;
+std::vector<bool> Input::selected_faces;
+int Input::RegionMode = Input::NO_REGION;
+std::vector<Vec2f> Input::Region;
 
 MeshObj Draw::mesh;
-int Draw::_DRAW_MODE = Draw::PER_FACE_NORMALS;
+LODChain Draw::lod;
+FaceClusters Draw::clusters;
+MeshWorker Draw::worker;
+SelectionBuffer Draw::selection;
+int Draw::_DRAW_MODE = Draw::PER_FACE_NORMALS | Draw::CLUSTER_CULLING;
 
 ///////////////////////////////////////////////////////////////////////////////
 
@@ -33,7 +130,7 @@ void Input::Reshape(int width, int height) {
 
   glMatrixMode(GL_PROJECTION); 
   glLoadIdentity();
-  gluPerspective(40, width/float(height), 1, 10);
+  gluPerspective(40, width/float(height), 1, 100);
 }
 
 Vec3f Input::ScreenToWorld(const int wind_id, int x, int y) { 
@@ -74,19 +171,26 @@ void Input::MouseClick (int button, int state, int x, int y) {
 
   if( state == GLUT_DOWN ) 
     {
-      Draw::draw_selectable();
+      // shift drags a box and ctrl a lasso, adding to the selection
+      int modifiers = glutGetModifiers();
+      if( modifiers & (GLUT_ACTIVE_SHIFT | GLUT_ACTIVE_CTRL) ) {
+	RegionMode = (modifiers & GLUT_ACTIVE_SHIFT) ? BOX : LASSO;
+	Region.assign(1, Vec2f(x, y));
+	return;
+      }
 
-      unsigned char pRGBA[4];
-      glReadBuffer( GL_BACK );
-      glReadPixels( x, y, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, pRGBA );
-      selected_face_color = 
-	//MeshObj::color_to_i(ColorVec4(pRGBA[0], pRGBA[1], pRGBA[2], pRGBA[3]));
-	MeshObj::color_to_i(pRGBA);
+      selected_face_color = Draw::selection.id_at(x, y);
+      ColorVec4 c = MeshObj::i_to_color(selected_face_color);
 
-      cout << "color: " << (int)pRGBA[0] << "," << (int)pRGBA[1] << "," 
-	   << (int)pRGBA[2] << "," << (int)pRGBA[3] << ","<< endl;
+      cout << "color: " << (int)c(0) << "," << (int)c(1) << "," 
+	   << (int)c(2) << "," << (int)c(3) << ","<< endl;
       
-
+      selected_faces.clear();
+      if( selected_face_color > 0 ) {
+	std::set<uint32_t> ids;
+	ids.insert(selected_face_color);
+	select(ids);
+      }
 
       //-------------------------------------------------------------------------
       Vec3f psphere; 
@@ -98,6 +202,19 @@ void Input::MouseClick (int button, int state, int x, int y) {
       glutPostRedisplay();
     } 
   if(state == GLUT_UP) { 
+    if( RegionMode != NO_REGION ) {
+      std::set<uint32_t> ids;
+      if( RegionMode == BOX ) 
+	Draw::selection.ids_in((int)Region[0].x(), (int)Region[0].y(), x, y, ids);
+      else 
+	Draw::selection.ids_in(Region, ids);
+      select(ids);
+      cout << "selected " << selected_colors().size() << " faces" << endl;
+      RegionMode = NO_REGION;
+      Region.clear();
+      glutPostRedisplay();
+      return;
+    }
     CurrentPsphere = NewPsphere;
   }
 }
@@ -107,6 +224,21 @@ void Input::MouseMotion(int x, int y) {
   y = Params::WindowHeight - y-1;
   Vec3f psphere;
 
+  if( RegionMode == BOX ) {
+    Vec2f a = Region[0];
+    Region.resize(1);
+    Region.push_back(Vec2f(x, a.y()));
+    Region.push_back(Vec2f(x, y));
+    Region.push_back(Vec2f(a.x(), y));
+    glutPostRedisplay();
+    return;
+  }
+  if( RegionMode == LASSO ) {
+    if( !(Region.back() == Vec2f(x, y)) ) Region.push_back(Vec2f(x, y));
+    glutPostRedisplay();
+    return;
+  }
+
   if(SpherePoint(View::SphereCenter, View::SphereRadius, 
 		 ScreenToWorld(Params::MainWindow, x, y), psphere)) {
     Vec3f tmpRotAxis = cross(CurrentPsphere-View::SphereCenter, 
@@ -127,50 +259,191 @@ void Input::MouseMotion(int x, int y) {
 }
 
 void Input::Keyboard(unsigned char key, int x, int y) {
+  // the mesh must not change under the worker
+  if( Draw::worker.busy() && edits_mesh(key) ) {
+    cout << "busy: " << Draw::worker.status() << endl;
+    return;
+  }
+
   switch( key )
     {
     case 'n':  Draw::toggle_mode(Draw::NORMALS_MODE);              
       break;
+    case 'l':  Draw::toggle_mode(Draw::LEVEL_OF_DETAIL);
+      break;
+    case 'f':  Draw::toggle_mode(Draw::CLUSTER_CULLING);
+      break;
+    case 'q':  Draw::toggle_mode(Draw::COMPACT_STORAGE);
+      Draw::lod.clear();
+      break;
+    case '[':  View::CameraPosition *= 0.8;
+      break;
+    case ']':  View::CameraPosition *= 1.25;
+      break;
     case 'x':
-      if( selected_face_color > 0 ) {
-	Draw::mesh.face_to_triangles(selected_face_color);
+      if( !selected_colors().empty() ) {
+	Draw::mesh.faces_to_triangles(selected_colors());
 	if( !Draw::mesh.validate() ) 
 	  throw "Input::Keyboard(): face split broke mesh.";
-	selected_face_color = 0;
       }
       break;
-    case 't':
-      Draw::mesh.convert_to_triangles();                  
-      if( !Draw::mesh.validate() ) 
-	throw "Input::Keyboard(): all faces split broke mesh.";    
+    case 't':  run_in_background("splitting into triangles", triangulate);
       break;
     case 'd':
-      if( selected_face_color > 0 ) {
-	if( Draw::mesh.delete_face(selected_face_color) ) {
+      if( !selected_colors().empty() ) {
+	if( Draw::mesh.delete_faces(selected_colors()) ) {
 	  if( ! Draw::mesh.validate() ) 
 	    throw "Input::Keyboard(): delete broke mesh";
 	}
-	selected_face_color = 0;
+	else cout << "delete would pinch a vertex" << endl;
       }
       break;
-    case 's':
-      Draw::mesh.convert_to_triangles();                  
-      if( !Draw::mesh.validate() ) 
-	throw "Input::Keyboard(): all faces split (for Loop subdivision) "
-	  "broke mesh.";
-      Draw::mesh.subdivide_faces();
-      if( !Draw::mesh.validate() ) 
-	throw "Input::Keyboard(): Loop subdivision broke mesh.";   
+    case 's':  run_in_background("Loop subdivision", loop_subdivide);
+      break;
+    case 'c':  run_in_background("Catmull-Clark subdivision", catmull_clark);
+      break;
+    case '-':  run_in_background("decimation", decimate_half);
+      break;
+    case 'r':  run_in_background("remeshing", remesh);
+      break;
+    case 'k':  run_in_background("removing debris", strip_debris);
+      break;
+    case 'h':  run_in_background("filling holes", fill_holes);
+      break;
+    case 'z':
+    case 'y':
+      if( key == 'z' ? Draw::mesh.undo() : Draw::mesh.redo() )
+	if( !Draw::mesh.validate() ) 
+	  throw "Input::Keyboard(): undo/redo broke mesh.";
       break;
     case 'v':  Draw::mesh.validate();
       break;
 
     default: ;
     }
+
+  // edits make the levels of detail, the clusters and the selection stale
+  if( edits_mesh(key) ) {
+    Draw::lod.clear();
+    Draw::clusters.clear();
+    selected_faces.clear();
+    selected_face_color = 0;
+  }
   
   glutPostRedisplay();
 }
 
+void Input::Poll(int value) {
+  // a failed operation leaves the mesh as it was, so the session goes on
+  bool changed = false;
+  try {
+    changed = Draw::worker.poll(Draw::mesh);
+  }
+  catch (const char* err_str) {
+    std::cerr << "ERROR: " << err_str << endl;
+  }
+  if( changed ) {
+    Draw::lod.clear();
+    Draw::clusters.clear();
+    selected_faces.clear();
+    selected_face_color = 0;
+    glutPostRedisplay();
+  }
+
+  std::string title("Trackball");
+  if( Draw::worker.busy() ) {
+    title += " - " + Draw::worker.status();
+    glutTimerFunc(POLL_MS, Poll, 0);
+  }
+  glutSetWindowTitle(title.c_str());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+SelectionBuffer::SelectionBuffer()
+  : _width(0), _height(0), _version(0), _mode(0), _valid(false)
+{  }
+
+void SelectionBuffer::_update(void) {
+  int mode = Draw::get_mode() & Draw::CLUSTER_CULLING;
+  if( _valid && _width == Params::WindowWidth && _height == Params::WindowHeight
+      && _version == Draw::mesh.version() && _mode == mode
+      && _camera == View::CameraPosition
+      && memcmp((const float*)_rotation, (const float*)View::ExaminerRotation,
+		16 * sizeof(float)) == 0 )
+    return;
+
+  _width = Params::WindowWidth;
+  _height = Params::WindowHeight;
+  _version = Draw::mesh.version();
+  _mode = mode;
+  _camera = View::CameraPosition;
+  _rotation = View::ExaminerRotation;
+  _valid = true;
+
+  // the next display redraws the scene over it
+  Draw::draw_selectable();
+  _pixels.resize(4 * _width * _height);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadBuffer( GL_BACK );
+  glReadPixels( 0, 0, _width, _height, GL_RGBA, GL_UNSIGNED_BYTE, &_pixels[0] );
+}
+
+uint32_t SelectionBuffer::id_at(int x, int y) {
+  _update();
+  if( x < 0 || y < 0 || x >= _width || y >= _height ) return 0;
+  return MeshObj::color_to_i(ColorVec4(&_pixels[4 * (y * _width + x)]));
+}
+
+void SelectionBuffer::ids_in(int x0, int y0, int x1, int y1,
+			     std::set<uint32_t>& ids) {
+  _update();
+  if( x0 > x1 ) std::swap(x0, x1);
+  if( y0 > y1 ) std::swap(y0, y1);
+  x0 = std::max(x0, 0);  x1 = std::min(x1, _width - 1);
+  y0 = std::max(y0, 0);  y1 = std::min(y1, _height - 1);
+  for( int y = y0; y <= y1; y++ )
+    for( int x = x0; x <= x1; x++ ) {
+      uint32_t id = MeshObj::color_to_i(ColorVec4(&_pixels[4 * (y * _width + x)]));
+      if( id != 0 ) ids.insert(id);
+    }
+}
+
+void SelectionBuffer::ids_in(const std::vector<Vec2f>& polygon,
+			     std::set<uint32_t>& ids) {
+  _update();
+  int n = polygon.size();
+  if( n < 3 ) return;
+  float lo = polygon[0].y(), hi = lo;
+  for( int i = 1; i < n; i++ ) {
+    lo = std::min(lo, polygon[i].y());
+    hi = std::max(hi, polygon[i].y());
+  }
+
+  // each row is filled between pairs of edge crossings at pixel centers
+  std::vector<float> xs;
+  for( int y = std::max(0, (int)ceil(lo - 0.5f)); 
+       y <= std::min(_height - 1, (int)floor(hi - 0.5f)); y++ ) {
+    float cy = y + 0.5f;
+    xs.clear();
+    for( int i = 0; i < n; i++ ) {
+      const Vec2f& a = polygon[i];
+      const Vec2f& b = polygon[(i + 1) % n];
+      if( (a.y() <= cy) != (b.y() <= cy) )
+	xs.push_back(a.x() + (cy - a.y()) / (b.y() - a.y()) * (b.x() - a.x()));
+    }
+    std::sort(xs.begin(), xs.end());
+    for( int k = 0; k + 1 < (int)xs.size(); k += 2 ) {
+      int x0 = std::max(0, (int)ceil(xs[k] - 0.5f));
+      int x1 = std::min(_width - 1, (int)ceil(xs[k + 1] - 0.5f) - 1);
+      for( int x = x0; x <= x1; x++ ) {
+	uint32_t id = MeshObj::color_to_i(ColorVec4(&_pixels[4 * (y * _width + x)]));
+	if( id != 0 ) ids.insert(id);
+      }
+    }
+  }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 void Draw::draw_scene() {
@@ -201,9 +474,11 @@ void Draw::draw_scene() {
 
   glEnable(GL_COLOR_MATERIAL);
 
-  draw_mesh( TRACKBALL | SELECTED );
+  if( _DRAW_MODE & LEVEL_OF_DETAIL ) draw_lod();
+  else draw_mesh( TRACKBALL | SELECTED );
 
   glDisable(GL_LIGHTING);
+  if( !Input::Region.empty() ) draw_region();
 
   glutSwapBuffers();
 }
@@ -221,44 +496,55 @@ void Draw::draw_selectable() {
 }
 
 void Draw::draw_mesh(int also_draw) {
-  bool selected = false;
+  if( clusters.empty() ) clusters.build(mesh);
+
   glPushMatrix();
     glMultMatrixf(View::ExaminerRotation);
-    
-    for( list<Face*>::const_iterator f_itr = mesh.faces().begin();
-	 f_itr != mesh.faces().end(); f_itr++ ) {
-
-      Edge *first_e = (*f_itr)->edge();
-      Edge *e_ptr = first_e;
-
-      if( also_draw & SELECTED ) {
-	//if( mesh.face_is_color_i(*f_itr, selected_color) ) {
-	if( selected == false &&
-	    mesh.face_is_color(*f_itr, Input::selected_face_color) ) {
-	  selected = true;
-	  glColor3fv( SELECTED_FACE_COLOR );
+
+    std::vector<int> shown;
+    if( _DRAW_MODE & CLUSTER_CULLING ) {
+      GLfloat modelview[16], projection[16];
+      glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+      glGetFloatv(GL_PROJECTION_MATRIX, projection);
+      clusters.visible(FaceClusters::Frustum(modelview, projection), shown);
+    }
+    else
+      for( int k = 0; k < (int)clusters.clusters().size(); k++ ) shown.push_back(k);
+
+    for( int k = 0; k < (int)shown.size(); k++ ) {
+      const FaceClusters::Cluster& c = clusters.clusters()[shown[k]];
+      for( unsigned int i = c.first; i < c.first + c.count; i++ ) {
+	Face* f = clusters.faces()[i];
+	Edge *first_e = f->edge();
+	Edge *e_ptr = first_e;
+
+	if( also_draw & SELECTED ) {
+	  if( f->index() < (int)Input::selected_faces.size() &&
+	      Input::selected_faces[f->index()] ) {
+	    glColor3fv( SELECTED_FACE_COLOR );
+	  }
+	  else {
+	    glColor3fv( DEFAULT_FACE_COLOR );
+	  }
 	}
-	else {
-	  glColor3fv( DEFAULT_FACE_COLOR );
+	else if( also_draw & SELECTABLE ) {
+	  glColor4ubv( MeshObj::i_to_color(mesh.face_to_color(f)) );
 	}
-      }
-      else if( also_draw & SELECTABLE ) {
-	glColor4ubv( MeshObj::i_to_color(mesh.face_to_color(*f_itr)) );
-      }
 
-      glBegin(GL_POLYGON);
+	glBegin(GL_POLYGON);
 
-        if( _DRAW_MODE & PER_FACE_NORMALS ) glNormal3fv((*f_itr)->normal());
-	do {
-	  if( _DRAW_MODE & PER_VERTEX_NORMALS ) 
-	    glNormal3fv(e_ptr->vert()->normal());
+	  if( _DRAW_MODE & PER_FACE_NORMALS ) glNormal3fv(f->normal());
+	  do {
+	    if( _DRAW_MODE & PER_VERTEX_NORMALS ) 
+	      glNormal3fv(e_ptr->vert()->normal());
 
-	  if( e_ptr->next() == NULL ) throw "Draw::draw_mesh: e->next == null";
-	  glVertex3fv(e_ptr->vert()->loc());
-	  e_ptr = e_ptr->next();
-	  
-	} while ( e_ptr != first_e );
-      glEnd();
+	    if( e_ptr->next() == NULL ) throw "Draw::draw_mesh: e->next == null";
+	    glVertex3fv(e_ptr->vert()->loc());
+	    e_ptr = e_ptr->next();
+	    
+	  } while ( e_ptr != first_e );
+	glEnd();
+      }
     }
 
     if( also_draw & TRACKBALL ) {
@@ -269,6 +555,77 @@ void Draw::draw_mesh(int also_draw) {
   glPopMatrix();
 }
 
+void Draw::draw_lod() {
+  if( lod.empty() ) {
+    lod.set_compact(_DRAW_MODE & COMPACT_STORAGE);
+    lod.build(mesh);
+    for( int i = 0; i < (int)lod.levels().size(); i++ )
+      cout << "level " << i << ": " << lod.levels()[i].count / 3
+	   << " triangles, ACMR " << lod.levels()[i].acmr_before << " -> "
+	   << lod.levels()[i].acmr_after << endl;
+  }
+
+  // a mesh without faces has no levels
+  if( lod.empty() ) return;
+  if( lod.compact() ? lod.compact_vertices().empty() : lod.vertices().empty() )
+    return;
+  const LODChain::Level& level = 
+    lod.levels()[lod.select(View::CameraPosition.l2())];
+
+  glPushMatrix();
+    glMultMatrixf(View::ExaminerRotation);
+    glColor3fv( DEFAULT_FACE_COLOR );
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    if( lod.compact() ) {
+      // the 16-bit positions are dequantized by the modelview matrix
+      const CompactVertices& c = lod.compact_vertices();
+      glPushMatrix();
+      glTranslatef(c.origin().x(), c.origin().y(), c.origin().z());
+      glScalef(c.step().x(), c.step().y(), c.step().z());
+      glEnable(GL_NORMALIZE);
+      glVertexPointer(3, GL_SHORT, 0, c.positions());
+      glNormalPointer(GL_SHORT, 0, &lod.draw_normals()[0]);
+      glDrawElements(GL_TRIANGLES, level.count, GL_UNSIGNED_INT,
+		     &lod.indices()[level.first]);
+      glDisable(GL_NORMALIZE);
+      glPopMatrix();
+    }
+    else {
+      glVertexPointer(3, GL_FLOAT, 6*sizeof(float), &lod.vertices()[0]);
+      glNormalPointer(GL_FLOAT, 6*sizeof(float), &lod.vertices()[3]);
+      glDrawElements(GL_TRIANGLES, level.count, GL_UNSIGNED_INT,
+		     &lod.indices()[level.first]);
+    }
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+
+    glutWireSphere(View::SphereRadius,10,10);
+  glPopMatrix();
+}
+
+void Draw::draw_region() {
+  glDisable(GL_DEPTH_TEST);
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+    glLoadIdentity();
+    gluOrtho2D(0, Params::WindowWidth, 0, Params::WindowHeight);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+      glLoadIdentity();
+      glColor3f(1, 1, 1);
+      glBegin(GL_LINE_LOOP);
+      for( int i = 0; i < (int)Input::Region.size(); i++ )
+	glVertex2f(Input::Region[i].x() + 0.5f, Input::Region[i].y() + 0.5f);
+      glEnd();
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+  glEnable(GL_DEPTH_TEST);
+}
+
 int Draw::get_mode(void) { return _DRAW_MODE; }
 
 void Draw::set_mode(int bits) {
@@ -282,7 +639,8 @@ void Draw::set_mode(int bits) {
 }
 
 void Draw::toggle_mode(int bits) {
-  if( bits != NORMALS_MODE )
+  if( bits != NORMALS_MODE && bits != LEVEL_OF_DETAIL && bits != CLUSTER_CULLING
+      && bits != COMPACT_STORAGE )
     throw "Draw::toggle_mode(int): Invalid mode requested.";
   
   _DRAW_MODE ^= bits;  //bitwise XOR assignment
@@ -5,6 +5,9 @@
 
 #include "headers.h"
 #include "mesh.h"
+#include "mesh-lod.h"
+#include "mesh-cluster.h"
+#include "mesh-worker.h"
 
 #ifndef __DEFAULT_COLORS__
 #define __DEFAULT_COLORS__
@@ -18,11 +21,44 @@ using std::endl;
 
 //-----------------------------------------------------------------------------
 
+/* The face ids of Draw::draw_selectable(), read back from the window once
+ * and kept until the view, the window size or the mesh changes, so picks
+ * are lookups and a region needs no further rendering.
+ */
+class SelectionBuffer {
+ public:
+  SelectionBuffer();
+
+  /* the color id of the face at a pixel (y from the bottom), 0 for none */
+  uint32_t id_at(int x, int y);
+  /* adds the ids of the faces seen in the box between two corner pixels */
+  void ids_in(int x0, int y0, int x1, int y1, std::set<uint32_t>& ids);
+  /* adds the ids of the faces seen inside a polygon (even-odd rule) */
+  void ids_in(const std::vector<Vec2f>& polygon, std::set<uint32_t>& ids);
+
+ private:
+  void _update(void);
+
+  std::vector<GLubyte> _pixels;
+  int _width, _height;
+  // what the ids were rendered with
+  HMatrix<float> _rotation;
+  Vec3f _camera;
+  unsigned int _version;
+  int _mode;
+  bool _valid;
+};
+
+//-----------------------------------------------------------------------------
+
 class Draw {
  public:
   enum {
     PER_FACE_NORMALS   = 1<<0,
     PER_VERTEX_NORMALS = 1<<1,
+    LEVEL_OF_DETAIL    = 1<<2,
+    CLUSTER_CULLING    = 1<<3,
+    COMPACT_STORAGE    = 1<<4,    // of the levels of detail
 
     NORMALS_MODE = PER_FACE_NORMALS|PER_VERTEX_NORMALS,
   };
@@ -40,14 +76,26 @@ class Draw {
   static void draw_selectable(); 
 
   static MeshObj mesh;
+  /* levels of detail of mesh; cleared by edits, rebuilt when drawn */
+  static LODChain lod;
+  /* face clusters of mesh for culling; cleared by edits, rebuilt when drawn */
+  static FaceClusters clusters;
+  /* runs the heavy edits of mesh in the background */
+  static MeshWorker worker;
+  /* face ids of mesh on screen, for picking */
+  static SelectionBuffer selection;
   
   static int get_mode(void);
   static void set_mode(int mode_bits);
-  static void toggle_mode(int mode_bits);  //mode_bits must be NORMALS_MODE
+  //mode_bits must be NORMALS_MODE, LEVEL_OF_DETAIL, CLUSTER_CULLING or
+  //COMPACT_STORAGE
+  static void toggle_mode(int mode_bits);
 
  private:
   static int _DRAW_MODE;
   static void draw_mesh(int also_draw=NONE);
+  static void draw_lod(void);
+  static void draw_region(void);
 };
 
 //-----------------------------------------------------------------------------
@@ -55,7 +103,13 @@ class Draw {
 class Input {
  public:
   static uint32_t selected_face_color;
-  static Face* selected_face;
+  /* the selected faces by Face::index(); cleared by edits */
+  static std::vector<bool> selected_faces;
+
+  /* a box (shift-drag) or lasso (ctrl-drag) being drawn, in pixels */
+  enum { NO_REGION, BOX, LASSO };
+  static int RegionMode;
+  static std::vector<Vec2f> Region;
 
   static Vec3f CurrentPsphere;
   static Vec3f NewPsphere;
@@ -67,6 +121,8 @@ class Input {
   static void MouseClick (int button, int state, int x, int y);
   static void MouseMotion(int x, int y);
   static void Keyboard(unsigned char key, int x, int y);
+  /* timer callback: takes in background results while the worker is busy */
+  static void Poll(int value);
 };
 
 #endif
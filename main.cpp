@@ -1,23 +1,98 @@
 #include "io.h"
 #include "mesh.h"
 #include "mesh-loader.h"
+#include "mesh-raster.h"
+#include "mesh-stream.h"
 #include "headers.h"
 #include "params.h"
 
 
+// operations for -ops, on one slab at a time
+static void triangulate(MeshObj& m) { m.convert_to_triangles(); }
+static void loop(MeshObj& m) { m.convert_to_triangles(); m.subdivide_faces(); }
+static void catmull_clark(MeshObj& m) { m.subdivide_catmull_clark(); }
+static void smooth(MeshObj& m) { m.smooth(); }
 
 int main( int argc, char* argv[] ) {
   const char* mesh_file;
 
+  // headless: -o thumbnail.ppm, -ids idbuffer.pam, -size WIDTHxHEIGHT
+  std::vector<const char*> args;
+  const char* thumbnail = NULL;
+  const char* id_buffer = NULL;
+  // out-of-core: -stream out.obj [-ops tscmn] [-slab FACES]
+  const char* stream_out = NULL;
+  const char* ops = "";
+  MeshStream::Options stream_options;
+  for( int i = 1; i < argc; i++ ) {
+    if( strcmp(argv[i], "-o") == 0 && i + 1 < argc ) thumbnail = argv[++i];
+    else if( strcmp(argv[i], "-ids") == 0 && i + 1 < argc ) id_buffer = argv[++i];
+    else if( strcmp(argv[i], "-size") == 0 && i + 1 < argc )
+      sscanf(argv[++i], "%dx%d", &Params::WindowWidth, &Params::WindowHeight);
+    else if( strcmp(argv[i], "-stream") == 0 && i + 1 < argc ) stream_out = argv[++i];
+    else if( strcmp(argv[i], "-ops") == 0 && i + 1 < argc ) ops = argv[++i];
+    else if( strcmp(argv[i], "-slab") == 0 && i + 1 < argc ) {
+      int faces = atoi(argv[++i]);
+      if( faces < 1 ) {
+	std::cerr << "usage: -slab FACES takes at least 1 face" << endl;
+	exit(1);
+      }
+      stream_options.max_faces = faces;
+    }
+    else args.push_back(argv[i]);
+  }
+
   // get name of object file (defaults to ./obj/spaceship.obj)
-  if( argc > 1 )  mesh_file = argv[1];
-  else            mesh_file = "./obj/spaceship.obj";
+  if( args.size() > 0 )  mesh_file = args[0];
+  else                   mesh_file = "./obj/spaceship.obj";
 
   try 
     {
+      // edits the file a slab at a time, without loading it
+      if( stream_out != NULL ) {
+	std::vector<MeshStream::Operation> list;
+	stream_options.rings = 0;
+	for( const char* c = ops; *c != 0; c++ ) {
+	  switch( *c ) {
+	  case 't': list.push_back(triangulate);    break;
+	  case 's': list.push_back(loop);           stream_options.rings += 2; break;
+	  case 'c': list.push_back(catmull_clark);  stream_options.rings += 2; break;
+	  case 'm': list.push_back(smooth);         stream_options.rings += 1; break;
+	  case 'n': stream_options.normals = true;  stream_options.rings += 1; break;
+	  default: throw "main(): -ops takes the letters t, s, c, m and n.";
+	  }
+	}
+	long n = MeshStream::process(mesh_file, stream_out, list, stream_options);
+	std::cout << "streamed " << n << " faces" << endl;
+	return 0;
+      }
+
       MeshLoad::OBJMesh *m = MeshLoad::readOBJ(mesh_file);
-      Draw::mesh = *m;
+      // optional: weld the vertices closer than the given distance
+      if( args.size() > 1 ) {
+	int n = MeshLoad::weldOBJ(*m, atof(args[1]));
+	std::cout << "welded " << n << " vertices" << endl;
+      }
+      // frees the file's buffers while the mesh is built
+      Draw::mesh = MeshObj(std::move(*m));
+      delete m;
+      Draw::mesh.set_journaling(true);
+      Draw::mesh.set_auto_reorder(true);
       Draw::set_mode(Draw::PER_FACE_NORMALS);
+
+      // renders with the viewer's start camera, without a window
+      if( thumbnail != NULL || id_buffer != NULL ) {
+	Rasterizer r(Params::WindowWidth, Params::WindowHeight);
+	if( thumbnail != NULL ) {
+	  r.draw_scene(Draw::mesh, Rasterizer::Camera(), DEFAULT_FACE_COLOR);
+	  r.write_ppm(thumbnail);
+	}
+	if( id_buffer != NULL ) {
+	  r.draw_selectable(Draw::mesh, Rasterizer::Camera());
+	  r.write_pam(id_buffer);
+	}
+	return 0;
+      }
     }
   catch (const char* err_str) 
     {
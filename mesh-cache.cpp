@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <cmath>
+#include "mesh-cache.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Vertex cache optimisation: triangles are emitted greedily by a score
+// which favours vertices recently used (in the cache) and vertices with
+// few triangles left (so no vertex is left behind with one or two)
+
+namespace {
+
+  // Forsyth's constants
+  const float CACHE_DECAY_POWER = 1.5f;
+  const float LAST_TRI_SCORE = 0.75f;
+  const float VALENCE_BOOST_SCALE = 2.0f;
+  const float VALENCE_BOOST_POWER = 0.5f;
+
+  // a vertex at the cache position (-1: not cached) with triangles left
+  float vertex_score(int position, int remaining) {
+    if( remaining == 0 ) return -1;
+    float s = 0;
+    if( position >= 0 ) {
+      if( position < 3 ) s = LAST_TRI_SCORE;
+      else s = pow(1.0f - (position - 3) / (float)(VertexCache::CACHE_SIZE - 3),
+		   CACHE_DECAY_POWER);
+    }
+    return s + VALENCE_BOOST_SCALE * pow((float)remaining, -VALENCE_BOOST_POWER);
+  }
+};
+
+void VertexCache::optimize(unsigned int* indices, int count, int nverts) {
+  int nt = count / 3;
+  if( nt == 0 ) return;
+
+  // the triangles at each vertex; the first remaining[v] are not added yet
+  std::vector<int> start(nverts + 1, 0), remaining(nverts, 0);
+  for( int i = 0; i < 3 * nt; i++ ) start[indices[i] + 1]++;
+  for( int v = 0; v < nverts; v++ ) {
+    remaining[v] = start[v + 1];
+    start[v + 1] += start[v];
+  }
+  std::vector<int> tris(3 * nt);
+  std::vector<int> fill(start.begin(), start.end() - 1);
+  for( int i = 0; i < 3 * nt; i++ ) tris[fill[indices[i]]++] = i / 3;
+
+  std::vector<int> position(nverts, -1);
+  std::vector<float> vscore(nverts), tscore(nt, 0);
+  for( int v = 0; v < nverts; v++ ) vscore[v] = vertex_score(-1, remaining[v]);
+  for( int i = 0; i < 3 * nt; i++ ) tscore[i / 3] += vscore[indices[i]];
+
+  std::vector<char> added(nt, 0);
+  std::vector<unsigned int> out;
+  out.reserve(3 * nt);
+  std::vector<int> cache, next;
+  int best = -1, scan = 0;
+  for( int emitted = 0; emitted < nt; emitted++ ) {
+    // when no cached vertex has triangles left, take the next one in order
+    if( best < 0 ) {
+      while( added[scan] ) scan++;
+      best = scan;
+    }
+    int t = best;
+    added[t] = 1;
+
+    next.clear();
+    for( int k = 0; k < 3; k++ ) {
+      int v = indices[3 * t + k];
+      out.push_back(v);
+      next.push_back(v);
+      int* l = &tris[start[v]];
+      for( int j = 0; j < remaining[v]; j++ )
+	if( l[j] == t ) { std::swap(l[j], l[remaining[v] - 1]);  break; }
+      remaining[v]--;
+    }
+    for( int i = 0; i < (int)cache.size(); i++ )
+      if( std::find(next.begin(), next.begin() + 3, cache[i]) == next.begin() + 3 )
+	next.push_back(cache[i]);
+
+    // rescore the vertices which moved in (or out of) the cache
+    for( int i = 0; i < (int)next.size(); i++ ) {
+      int v = next[i];
+      position[v] = (i < CACHE_SIZE) ? i : -1;
+      float s = vertex_score(position[v], remaining[v]);
+      float delta = s - vscore[v];
+      vscore[v] = s;
+      for( int j = 0; j < remaining[v]; j++ ) tscore[tris[start[v] + j]] += delta;
+    }
+    if( (int)next.size() > CACHE_SIZE ) next.resize(CACHE_SIZE);
+    cache.swap(next);
+
+    best = -1;
+    float best_score = -1;
+    for( int i = 0; i < (int)cache.size(); i++ ) {
+      int v = cache[i];
+      for( int j = 0; j < remaining[v]; j++ ) {
+	int u = tris[start[v] + j];
+	if( tscore[u] > best_score ) { best_score = tscore[u];  best = u; }
+      }
+    }
+  }
+  // an order which is already good (such as after MeshObj::reorder) is kept
+  if( acmr(&out[0], 3 * nt) < acmr(indices, 3 * nt) )
+    std::copy(out.begin(), out.end(), indices);
+}
+
+void VertexCache::reorder_vertices(std::vector<float>& vertices, int stride,
+				   std::vector<unsigned int>& indices) {
+  int nv = vertices.size() / stride;
+  std::vector<int> remap(nv, -1);
+  int n = 0;
+  for( int i = 0; i < (int)indices.size(); i++ ) {
+    int& r = remap[indices[i]];
+    if( r < 0 ) r = n++;
+    indices[i] = r;
+  }
+  for( int v = 0; v < nv; v++ )
+    if( remap[v] < 0 ) remap[v] = n++;
+
+  std::vector<float> moved(vertices.size());
+#pragma omp parallel for
+  for( int v = 0; v < nv; v++ )
+    std::copy(&vertices[v * stride], &vertices[v * stride] + stride,
+	      &moved[remap[v] * stride]);
+  vertices.swap(moved);
+}
+
+float VertexCache::acmr(const unsigned int* indices, int count, int cache_size) {
+  int nt = count / 3;
+  if( nt == 0 ) return 0;
+  unsigned int n = 0;
+  for( int i = 0; i < 3 * nt; i++ ) n = std::max(n, indices[i] + 1);
+
+  // a FIFO cache holds the vertices of the last cache_size misses
+  std::vector<int> loaded(n, -1);
+  int misses = 0;
+  for( int i = 0; i < 3 * nt; i++ ) {
+    int& l = loaded[indices[i]];
+    if( l < 0 || misses - l >= cache_size ) l = misses++;
+  }
+  return misses / (float)nt;
+}
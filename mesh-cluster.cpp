@@ -0,0 +1,157 @@
+#include <cmath>
+#include "mesh-cluster.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// class FaceClusters
+
+namespace {
+
+  // the unit normals of the triangles of f's fan (degenerate ones left out)
+  void fan_normals(const Face* f, std::vector<Vec3f>& out) {
+    const Vec3f& o = f->edge()->vert()->loc();
+    for( Edge* e = f->edge()->next(); e->next() != f->edge(); e = e->next() ) {
+      Vec3f n = cross(e->vert()->loc() - o, e->next()->vert()->loc() - o);
+      float len = n.l2();
+      if( len > 0 ) out.push_back(n / len);
+    }
+  }
+};
+
+FaceClusters::Frustum::Frustum(const float* modelview, const float* projection) {
+  // rows of projection * modelview
+  float m[4][4];
+  for( int i = 0; i < 4; i++ )
+    for( int j = 0; j < 4; j++ ) {
+      m[i][j] = 0;
+      for( int k = 0; k < 4; k++ )
+	m[i][j] += projection[i + 4*k] * modelview[k + 4*j];
+    }
+
+  // -w <= x, y, z <= w in clip space
+  for( int i = 0; i < 3; i++ )
+    for( int s = 0; s < 2; s++ ) {
+      float sign = s ? -1 : 1;
+      Vec4f& p = planes[2*i + s];
+      for( int j = 0; j < 4; j++ ) p(j) = m[3][j] + sign * m[i][j];
+      float len = Vec3f(p.x(), p.y(), p.z()).l2();
+      if( len > 0 ) p /= len;
+    }
+
+  // the camera at the origin, back through the rotation and translation
+  for( int k = 0; k < 3; k++ )
+    eye(k) = -(modelview[4*k] * modelview[12] + modelview[4*k + 1] * modelview[13]
+	       + modelview[4*k + 2] * modelview[14]);
+}
+
+FaceClusters::FaceClusters()
+{  }
+
+void FaceClusters::build(MeshObj& mesh, int max_faces, float max_angle) {
+  clear();
+  mesh.index_elements();
+  std::vector<Face*> faces(mesh.faces().begin(), mesh.faces().end());
+  int nf = faces.size();
+
+  std::vector<Vec3f> normals(nf);
+#pragma omp parallel for
+  for( int i = 0; i < nf; i++ ) {
+    Vec3f n = faces[i]->calculate_normal();
+    float len = n.l2();
+    normals[i] = (len > 0) ? n / len : n;
+  }
+
+  // breadth first from each face not yet in a cluster
+  float min_dot = cos(max_angle);
+  std::vector<char> taken(nf, 0);
+  _faces.reserve(nf);
+  for( int seed = 0; seed < nf; seed++ ) {
+    if( taken[seed] ) continue;
+    Cluster c;
+    c.first = _faces.size();
+    taken[seed] = 1;
+    _faces.push_back(faces[seed]);
+    for( int q = c.first; q < (int)_faces.size(); q++ ) {
+      FaceEdgeRange r = _faces[q]->edges();
+      for( FaceEdgeRange::iterator e = r.begin(); e != r.end(); ++e ) {
+	Face* g = e->opp()->face();
+	if( g == NULL || taken[g->index()] ) continue;
+	if( (int)(_faces.size() - c.first) >= max_faces ) break;
+	if( normals[g->index()].dot(normals[seed]) < min_dot ) continue;
+	taken[g->index()] = 1;
+	_faces.push_back(g);
+      }
+    }
+    c.count = _faces.size() - c.first;
+    _clusters.push_back(c);
+  }
+
+  // bounding spheres and normal cones
+#pragma omp parallel for schedule(dynamic)
+  for( int k = 0; k < (int)_clusters.size(); k++ ) {
+    Cluster& c = _clusters[k];
+    std::vector<Vec3f> ns;
+    Vec3f lo = _faces[c.first]->edge()->vert()->loc(), hi = lo;
+    for( unsigned int i = c.first; i < c.first + c.count; i++ ) {
+      FaceVertRange r = _faces[i]->verts();
+      for( FaceVertRange::iterator v = r.begin(); v != r.end(); ++v ) {
+	lo = lo.min(v->loc());
+	hi = hi.max(v->loc());
+      }
+      fan_normals(_faces[i], ns);
+    }
+    c.center = (lo + hi) / 2;
+    c.radius = 0;
+    for( unsigned int i = c.first; i < c.first + c.count; i++ ) {
+      FaceVertRange r = _faces[i]->verts();
+      for( FaceVertRange::iterator v = r.begin(); v != r.end(); ++v )
+	c.radius = std::max(c.radius, (v->loc() - c.center).l2());
+    }
+
+    c.axis = Vec3f(0, 0, 0);
+    for( int i = 0; i < (int)ns.size(); i++ ) c.axis += ns[i];
+    float len = c.axis.l2();
+    c.cutoff = -1;
+    if( len > 0 ) {
+      c.axis /= len;
+      c.cutoff = 1;
+      for( int i = 0; i < (int)ns.size(); i++ )
+	c.cutoff = std::min(c.cutoff, ns[i].dot(c.axis));
+    }
+  }
+}
+
+void FaceClusters::clear(void) {
+  _clusters.clear();
+  _faces.clear();
+}
+
+bool FaceClusters::empty(void) const { return _clusters.empty(); }
+
+void FaceClusters::visible(const Frustum& view, std::vector<int>& out) const {
+  for( int k = 0; k < (int)_clusters.size(); k++ ) {
+    const Cluster& c = _clusters[k];
+
+    bool inside = true;
+    for( int i = 0; i < 6 && inside; i++ ) {
+      const Vec4f& p = view.planes[i];
+      inside = p.x() * c.center.x() + p.y() * c.center.y()
+	+ p.z() * c.center.z() + p.w() >= -c.radius;
+    }
+    if( !inside ) continue;
+
+    /* every face points away if the eye sees every point of the sphere
+     * at more than 90 degrees plus the cone's half angle from the axis
+     */
+    if( c.cutoff > 0 ) {
+      Vec3f d = c.center - view.eye;
+      float s = sqrt(std::max(0.0f, 1 - c.cutoff * c.cutoff));
+      if( d.dot(c.axis) > s * d.l2() + c.radius * (1 + s) ) continue;
+    }
+    out.push_back(k);
+  }
+}
+
+const std::vector<FaceClusters::Cluster>& FaceClusters::clusters(void) const {
+  return _clusters;
+}
+const std::vector<Face*>& FaceClusters::faces(void) const { return _faces; }
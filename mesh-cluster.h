@@ -0,0 +1,56 @@
+#ifndef __MESH_CLUSTER_H__
+#define __MESH_CLUSTER_H__
+
+#include <vector>
+#include "mesh.h"
+
+//-----------------------------------------------------------------------------
+
+/* The faces of a mesh in small connected clusters of similar orientation,
+ * each bounded by a sphere and a cone of normals, so that clusters outside
+ * the view frustum or facing away from the eye can be skipped as a whole.
+ */
+class FaceClusters {
+ public:
+  struct Cluster {
+    Cluster() : center(0, 0, 0), radius(0), axis(0, 0, 0), cutoff(-1),
+		first(0), count(0) {  }
+    Vec3f center;         // bounding sphere of the vertices
+    float radius;
+    Vec3f axis;           // the normals are within acos(cutoff) of axis
+    float cutoff;         // (never facing away when cutoff <= 0)
+    unsigned int first;   // offset into faces()
+    unsigned int count;
+  };
+
+  /* a camera in mesh coordinates, from OpenGL (column-major) matrices;
+   * the modelview matrix must not scale
+   */
+  struct Frustum {
+    Frustum(const float* modelview, const float* projection);
+    Vec4f planes[6];      // a x + b y + c z + d >= 0 inside, (a,b,c) unit
+    Vec3f eye;
+  };
+
+  FaceClusters();
+
+  /* Groups the faces into clusters of up to max_faces faces, each grown
+   * over edges from a seed face to faces within max_angle (radians) of
+   * the seed's normal.
+   */
+  void build(MeshObj& mesh, int max_faces = 256, float max_angle = 1.0);
+  void clear(void);
+  bool empty(void) const;
+
+  /* appends the clusters which may be seen from the frustum's eye */
+  void visible(const Frustum& view, std::vector<int>& out) const;
+
+  const std::vector<Cluster>& clusters(void) const;
+  const std::vector<Face*>& faces(void) const;
+
+ private:
+  std::vector<Cluster> _clusters;
+  std::vector<Face*> _faces;
+};
+
+#endif
@@ -0,0 +1,190 @@
+#include <atomic>
+#include "mesh.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Connected components: faces which share an edge are in the same component
+
+namespace {
+
+  typedef std::vector<std::atomic<int> > Parents;
+
+  // the root of x; halves the path on the way (roots only ever get smaller)
+  int find(Parents& parent, int x) {
+    while( true ) {
+      int p = parent[x];
+      int g = parent[p];
+      if( p == g ) return p;
+      parent[x].compare_exchange_weak(p, g);
+      x = g;
+    }
+  }
+
+  // lock-free: the larger root is linked under the smaller one
+  void unite(Parents& parent, int a, int b) {
+    while( true ) {
+      a = find(parent, a);
+      b = find(parent, b);
+      if( a == b ) return;
+      if( a < b ) std::swap(a, b);
+      int root = a;
+      if( parent[a].compare_exchange_strong(root, b) ) return;
+    }
+  }
+
+  float area(const Face* f) {
+    Vec3f sum(0, 0, 0);
+    const Vec3f& o = f->edge()->vert()->loc();
+    for( Edge* e = f->edge()->next(); e->next() != f->edge(); e = e->next() )
+      sum += cross(e->vert()->loc() - o, e->next()->vert()->loc() - o);
+    return 0.5f * sum.l2();
+  }
+};
+
+int MeshObj::label_components(std::vector<int>& face_ids,
+			      std::vector<int>& vert_ids,
+			      std::vector<Component>& stats) {
+  index_elements();
+  std::vector<Face*> faces(_faces.begin(), _faces.end());
+  std::vector<Vert*> verts(_verts.begin(), _verts.end());
+  std::vector<Edge*> edges(_edges.begin(), _edges.end());
+  int nf = faces.size(), nv = verts.size(), ne = edges.size();
+
+  Parents parent(nf);
+#pragma omp parallel for
+  for( int i = 0; i < nf; i++ ) parent[i] = i;
+#pragma omp parallel for
+  for( int i = 0; i < ne; i++ ) {
+    Face* f = edges[i]->face();
+    Face* g = edges[i]->opp()->face();
+    if( f != NULL && g != NULL && f->index() < g->index() )
+      unite(parent, f->index(), g->index());
+  }
+
+  // each root is the first face of its component
+  std::vector<int> root(nf), label(nf, -1);
+#pragma omp parallel for
+  for( int i = 0; i < nf; i++ ) root[i] = find(parent, i);
+  int n = 0;
+  for( int i = 0; i < nf; i++ )
+    if( root[i] == i ) label[i] = n++;
+
+  face_ids.resize(nf);
+#pragma omp parallel for
+  for( int i = 0; i < nf; i++ ) face_ids[i] = label[root[i]];
+
+  vert_ids.assign(nv, -1);
+#pragma omp parallel for
+  for( int i = 0; i < nv; i++ ) {
+    Edge* e = verts[i]->edge();
+    if( e == NULL ) continue;
+    Face* f = (e->face() != NULL) ? e->face() : e->opp()->face();
+    if( f != NULL ) vert_ids[i] = face_ids[f->index()];
+  }
+
+  Component empty;
+  empty.faces = 0;
+  empty.area = 0;
+  empty.lo = Vec3f(FLT_MAX, FLT_MAX, FLT_MAX);
+  empty.hi = Vec3f(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+  stats.assign(n, empty);
+#pragma omp parallel
+  {
+    std::vector<Component> local(n, empty);
+#pragma omp for
+    for( int i = 0; i < nf; i++ ) {
+      Component& c = local[face_ids[i]];
+      c.faces++;
+      c.area += area(faces[i]);
+      FaceVertRange r = faces[i]->verts();
+      for( FaceVertRange::iterator v = r.begin(); v != r.end(); ++v ) {
+	c.lo = c.lo.min(v->loc());
+	c.hi = c.hi.max(v->loc());
+      }
+    }
+#pragma omp critical
+    for( int k = 0; k < n; k++ ) {
+      stats[k].faces += local[k].faces;
+      stats[k].area += local[k].area;
+      stats[k].lo = stats[k].lo.min(local[k].lo);
+      stats[k].hi = stats[k].hi.max(local[k].hi);
+    }
+  }
+  return n;
+}
+
+void MeshObj::split_components(std::vector<MeshObj>& parts) {
+  std::vector<int> face_ids, vert_ids;
+  std::vector<Component> stats;
+  int n = label_components(face_ids, vert_ids, stats);
+
+  std::vector<std::vector<Face*> > members(n);
+  int k = 0;
+  for( FaceItr i = _faces.begin(); i != _faces.end(); i++, k++ )
+    members[face_ids[k]].push_back(*i);
+
+  parts.clear();
+  parts.resize(n);
+  // components share no vertices, so they can number theirs in one array
+  std::vector<int> local(_verts.size(), -1);
+#pragma omp parallel for schedule(dynamic)
+  for( int c = 0; c < n; c++ ) {
+    MeshLoad::OBJMesh obj;
+    std::vector<int> vslots, fslots, eslots;
+    obj.face_startidx.reserve(members[c].size());
+    for( int i = 0; i < (int)members[c].size(); i++ ) {
+      obj.face_startidx.push_back(obj.faces.size());
+      fslots.push_back(members[c][i]->slot());
+      FaceEdgeRange r = members[c][i]->edges();
+      for( FaceEdgeRange::iterator e = r.begin(); e != r.end(); ++e ) {
+	Vert* v = e->vert();
+	eslots.push_back(e->slot());
+	int& id = local[v->index()];
+	if( id < 0 ) {
+	  id = obj.pos.size();
+	  obj.pos.push_back(v->loc());
+	  vslots.push_back(v->slot());
+	}
+	obj.faces.push_back(MeshLoad::VTXindex(id, -1, -1));
+      }
+    }
+
+    MeshObj& part = parts[c];
+    part.construct(obj, &obj);
+    part._vprops = _vprops.gather(vslots);
+    part._fprops = _fprops.gather(fslots);
+    // the boundary half-edges come after the corners
+    part._eprops = _eprops.gather(eslots);
+    part._eprops.resize(part._edges.size());
+    part._color_to_face.clear();
+    part._face_to_color.clear();
+    int i = 0;
+    for( FaceItr f = part._faces.begin(); f != part._faces.end(); f++, i++ ) {
+      uint32_t color = face_to_color(members[c][i]);
+      part._color_to_face[color] = *f;
+      part._face_to_color[*f] = color;
+    }
+  }
+}
+
+int MeshObj::remove_small_components(unsigned int min_faces) {
+  std::vector<int> face_ids, vert_ids;
+  std::vector<Component> stats;
+  int n = label_components(face_ids, vert_ids, stats);
+
+  int removed = 0;
+  for( int c = 0; c < n; c++ )
+    if( stats[c].faces < min_faces ) removed++;
+  if( removed == 0 ) return 0;
+
+  std::set<uint32_t> colors;
+  int k = 0;
+  for( FaceItr i = _faces.begin(); i != _faces.end(); i++, k++ )
+    if( stats[face_ids[k]].faces < min_faces ) colors.insert(face_to_color(*i));
+
+  JournalScope edit(this, false);
+  _reorder_after_edit();
+  // whole components leave no vertex with two fans
+  if( !delete_faces(colors) )
+    throw "MeshObj::remove_small_components(unsigned int): delete failed.";
+  return removed;
+}
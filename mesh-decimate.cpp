@@ -0,0 +1,404 @@
+#include <queue>
+#include "mesh.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Quadric error decimation (Garland & Heckbert) by half-edge collapses
+
+namespace {
+
+  // symmetric 4x4 matrix stored as its upper triangle
+  struct Quadric {
+    double a[10];
+
+    Quadric() { for( int i = 0; i < 10; i++ ) a[i] = 0; }
+
+    // quadric of the plane n.p + d = 0, scaled by w
+    Quadric(const Vec3f& n, double d, double w) {
+      a[0] = w*n.x()*n.x(); a[1] = w*n.x()*n.y(); a[2] = w*n.x()*n.z();
+      a[3] = w*n.x()*d;     a[4] = w*n.y()*n.y(); a[5] = w*n.y()*n.z();
+      a[6] = w*n.y()*d;     a[7] = w*n.z()*n.z(); a[8] = w*n.z()*d;
+      a[9] = w*d*d;
+    }
+
+    Quadric& operator+=(const Quadric& q) {
+      for( int i = 0; i < 10; i++ ) a[i] += q.a[i];
+      return *this;
+    }
+
+    double error(const Vec3f& p) const {
+      double x = p.x(), y = p.y(), z = p.z();
+      return x*x*a[0] + 2*x*y*a[1] + 2*x*z*a[2] + 2*x*a[3]
+	+ y*y*a[4] + 2*y*z*a[5] + 2*y*a[6]
+	+ z*z*a[7] + 2*z*a[8] + a[9];
+    }
+  };
+
+  // heap entry; stale entries are skipped when their stamp is outdated
+  struct Candidate {
+    float cost;
+    Edge* edge;
+    unsigned int stamp;
+
+    bool operator<(const Candidate& c) const { return cost > c.cost; }
+  };
+
+  // weight of the planes which keep boundary edges in place
+  const double BOUNDARY_WEIGHT = 100.0;
+
+  Quadric face_quadric(const Face* f) {
+    Vec3f n = f->calculate_normal();
+    double len = n.l2();
+    if( len == 0 ) return Quadric();
+    n /= len;
+    return Quadric(n, -n.dot(f->edge()->vert()->loc()), 1.0);
+  }
+
+  // plane through a boundary edge, perpendicular to its face
+  Quadric boundary_quadric(const Edge* e) {
+    const Edge* in = e->opp();
+    Vec3f d = in->vert()->loc() - e->vert()->loc();
+    Vec3f n = cross(d, in->face()->calculate_normal());
+    double len = n.l2();
+    if( len == 0 ) return Quadric();
+    n /= len;
+    return Quadric(n, -n.dot(e->vert()->loc()), BOUNDARY_WEIGHT);
+  }
+
+  // picks the cheaper direction to collapse the edge in; with
+  // lock_boundary, directions which remove a boundary vertex cost FLT_MAX
+  Candidate evaluate(Edge* e, const std::vector<Quadric>& q, unsigned int s,
+		     bool lock_boundary) {
+    Edge* o = e->opp();
+    Quadric sum = q[e->vert()->index()];
+    sum += q[o->vert()->index()];
+    double to_e = sum.error(e->vert()->loc());
+    double to_o = sum.error(o->vert()->loc());
+    if( lock_boundary ) {
+      if( o->vert()->edge()->face() == NULL ) to_e = FLT_MAX;
+      if( e->vert()->edge()->face() == NULL ) to_o = FLT_MAX;
+    }
+    Candidate c;
+    c.edge  = (to_e <= to_o) ? e : o;
+    c.cost  = (to_e <= to_o) ? to_e : to_o;
+    c.stamp = s;
+    return c;
+  }
+
+  // membership in a sorted list of removed elements
+  template <class T> class InList {
+   public:
+    InList(const std::vector<T*>& l) : _l(l) {  }
+    bool operator()(T* x) const {
+      return std::binary_search(_l.begin(), _l.end(), x);
+    }
+   private:
+    const std::vector<T*>& _l;
+  };
+
+  template <class T> void take_out(std::list<T*>& from, std::vector<T*> dead) {
+    if( dead.empty() ) return;
+    std::sort(dead.begin(), dead.end());
+    from.remove_if(InList<T>(dead));
+  }
+
+  // would the collapse join v to another boundary vertex through the
+  // interior? A mesh cut out of a bigger one may have that edge on the
+  // other side of the cut, so locked boundaries must not get such chords.
+  bool collapse_adds_chord(const Edge* h) {
+    const Edge* o = h->opp();
+    const Vert* v = h->vert();
+    if( v->edge()->face() != NULL ) return false;
+
+    const Vert* a = (h->face() != NULL) ? h->next()->vert() : NULL;
+    const Vert* b = (o->face() != NULL) ? o->next()->vert() : NULL;
+    Edge* s = o->vert()->edge();
+    Edge* e = s;
+    do {
+      const Vert* w = e->vert();
+      if( w != v && w != a && w != b && w->edge()->face() == NULL ) return true;
+      e = e->opp()->next();
+    } while( e != s );
+    return false;
+  }
+};
+
+int MeshObj::decimate(unsigned int target_faces, float max_error,
+		      bool lock_boundary) {
+  JournalScope edit(this, true);
+  _reorder_after_edit();
+  index_elements();
+
+  std::vector<Vert*> verts(_verts.begin(), _verts.end());
+  std::vector<Face*> faces(_faces.begin(), _faces.end());
+  std::vector<Edge*> edges(_edges.begin(), _edges.end());
+  int nv = verts.size();
+  int nf = faces.size();
+  int ne = edges.size();
+
+  for( int i = 0; i < nf; i++ )
+    if( faces[i]->edge_count() != 3 )
+      throw "MeshObj::decimate(unsigned int, float, bool): expects an all-triangle mesh.";
+
+  // per-vertex quadrics, summed from the adjacent face and boundary planes
+  std::vector<Quadric> face_q(nf);
+#pragma omp parallel for
+  for( int i = 0; i < nf; i++ )
+    face_q[i] = face_quadric(faces[i]);
+
+  std::vector<Quadric> vert_q(nv);
+#pragma omp parallel for
+  for( int i = 0; i < nv; i++ ) {
+    VertEdgeRange ring = verts[i]->edges();
+    for( VertEdgeRange::iterator e = ring.begin(); e != ring.end(); ++e ) {
+      if( e->face() != NULL )
+	vert_q[i] += face_q[e->face()->index()];
+      else
+	vert_q[i] += boundary_quadric(*e);
+      if( e->opp()->face() == NULL )
+	vert_q[i] += boundary_quadric(e->opp());
+    }
+  }
+  face_q.clear();
+
+  // the cheaper direction of each edge goes on the heap; a candidate is
+  // current as long as its stamp matches the one of its half-edge. Both
+  // halves are restamped together since collapses re-pair opposites.
+  std::vector<unsigned int> stamp(ne, 0);
+  unsigned int last_stamp = 0;
+  std::priority_queue<Candidate> heap;
+
+  for( int i = 0; i < ne; i++ )
+    if( edges[i] < edges[i]->opp() )
+      heap.push(evaluate(edges[i], vert_q, 0, lock_boundary));
+
+  std::vector<Edge*> dead_edges;
+  std::vector<Face*> dead_faces;
+  std::vector<Vert*> dead_verts;
+  std::vector<char> dead(ne, 0);
+  unsigned int face_count = nf;
+  int collapses = 0;
+
+  while( face_count > target_faces && !heap.empty() ) {
+    Candidate c = heap.top();
+    heap.pop();
+    if( c.cost > max_error || c.cost == FLT_MAX ) break;
+
+    Edge* h = c.edge;
+    if( dead[h->index()] || stamp[h->index()] != c.stamp ) continue;
+    if( !_collapse_ok(h) || _collapse_flips(h) ) continue;
+    if( lock_boundary && collapse_adds_chord(h) ) continue;
+
+    Vert* u = h->opp()->vert();
+    Vert* v = h->vert();
+    vert_q[v->index()] += vert_q[u->index()];
+
+    int first_dead = dead_edges.size();
+    dead_verts.push_back(_collapse(h, dead_edges, dead_faces));
+    for( int i = first_dead; i < (int)dead_edges.size(); i++ )
+      dead[dead_edges[i]->index()] = 1;
+    face_count = nf - dead_faces.size();
+    collapses++;
+
+    // v's quadric changed: re-evaluate every edge around it
+    Edge* s = v->edge();
+    Edge* e = s;
+    do {
+      stamp[e->index()] = stamp[e->opp()->index()] = ++last_stamp;
+      heap.push(evaluate(e, vert_q, last_stamp, lock_boundary));
+      e = e->opp()->next();
+    } while( e != s );
+  }
+
+  _purge(dead_edges, dead_faces, dead_verts);
+
+  // recalculate normals
+  faces.assign(_faces.begin(), _faces.end());
+  verts.assign(_verts.begin(), _verts.end());
+#pragma omp parallel for
+  for( int i = 0; i < (int)faces.size(); i++ )
+    faces[i]->normal() = faces[i]->calculate_normal();
+#pragma omp parallel for
+  for( int i = 0; i < (int)verts.size(); i++ )
+    verts[i]->normal() = verts[i]->calculate_normal();
+
+  return collapses;
+}
+
+bool MeshObj::collapse_edge(Edge* h) {
+  return collapse_edges(std::vector<Edge*>(1, h)) == 1;
+}
+
+int MeshObj::collapse_edges(const std::vector<Edge*>& edges) {
+  JournalScope edit(this, false);
+  std::vector<Edge*> dead_edges;
+  std::vector<Face*> dead_faces;
+  std::vector<Vert*> dead_verts;
+  std::vector<char> dead(_eprops.slots(), 0);   // by slot, none is freed
+  int collapses = 0;
+
+  for( int i = 0; i < (int)edges.size(); i++ ) {
+    Edge* h = edges[i];
+    if( dead[h->slot()] || !_collapse_ok(h) ) continue;
+    _journal_touch_ring(h->vert());
+    _journal_touch_ring(h->opp()->vert());
+
+    Vert* v = h->vert();
+    int first_dead = dead_edges.size();
+    dead_verts.push_back(_collapse(h, dead_edges, dead_faces));
+    for( int j = first_dead; j < (int)dead_edges.size(); j++ )
+      dead[dead_edges[j]->slot()] = 1;
+    collapses++;
+
+    Edge* s = v->edge();
+    Edge* e = s;
+    do {
+      if( e->face() != NULL ) e->face()->normal() = e->face()->calculate_normal();
+      e->vert()->normal() = e->vert()->calculate_normal();
+      e = e->opp()->next();
+    } while( e != s );
+    v->normal() = v->calculate_normal();
+  }
+
+  if( collapses > 0 ) _purge(dead_edges, dead_faces, dead_verts);
+  return collapses;
+}
+
+bool MeshObj::_collapse_ok(Edge* h) const {
+  Edge* o = h->opp();
+  Vert* u = o->vert();
+  Vert* v = h->vert();
+
+  if( h->face() != NULL && h->next()->next()->next() != h ) return false;
+  if( o->face() != NULL && o->next()->next()->next() != o ) return false;
+
+  // an interior edge joining two boundary vertices would pinch the surface
+  if( h->face() != NULL && o->face() != NULL
+      && u->edge()->face() == NULL && v->edge()->face() == NULL )
+    return false;
+
+  // the tips of the adjacent triangles lose an edge; they must keep 3
+  Vert* a = (h->face() != NULL) ? h->next()->vert() : NULL;
+  Vert* b = (o->face() != NULL) ? o->next()->vert() : NULL;
+  if( a == b ) return false;
+  if( a != NULL && a->count_adjacent() <= (a->edge()->face() ? 3 : 2) ) 
+    return false;
+  if( b != NULL && b->count_adjacent() <= (b->edge()->face() ? 3 : 2) ) 
+    return false;
+
+  // link condition: u and v may only share the tips as neighbours
+  VertVertRange ring_u = u->neighbours(), ring_v = v->neighbours();
+  for( VertVertRange::iterator w = ring_u.begin(); w != ring_u.end(); ++w ) {
+    if( *w == v || *w == a || *w == b ) continue;
+    for( VertVertRange::iterator x = ring_v.begin(); x != ring_v.end(); ++x )
+      if( *x == *w ) return false;
+  }
+
+  return true;
+}
+
+Vert* MeshObj::_collapse(Edge* h, std::vector<Edge*>& dead_edges,
+			 std::vector<Face*>& dead_faces) {
+  Edge* o = h->opp();
+  Vert* u = o->vert();
+  Vert* v = h->vert();
+
+  // boundary predecessors have to be found before anything is relinked
+  Edge* h_prev = (h->face() == NULL) ? h->prev() : NULL;
+  Edge* o_prev = (o->face() == NULL) ? o->prev() : NULL;
+
+  // everything that ended at u ends at v, the corners taking those of v
+  // in h's face (o's along the boundary)
+  Edge* corner = (h->face() != NULL) ? h : o->prev();
+  Edge* e = u->edge();
+  do {
+    e->opp()->vert() = v;
+    if( e->opp()->face() != NULL ) _eprops.copy(e->opp()->slot(), corner->slot());
+    e = e->opp()->next();
+  } while( e != u->edge() );
+
+  Edge* start;  // an outgoing edge of v which survives
+  if( h->face() != NULL ) {
+    Edge* h1 = h->next();
+    Edge* h2 = h1->next();
+    Edge* h1o = h1->opp();
+    Edge* h2o = h2->opp();
+    h1o->opp() = h2o;
+    h2o->opp() = h1o;
+    if( h1->vert()->edge() == h2 ) h1->vert()->edge() = h1o;
+    dead_edges.push_back(h1);
+    dead_edges.push_back(h2);
+    dead_faces.push_back(h->face());
+    start = h2o;
+  }
+  else {
+    h_prev->next() = h->next();
+    h->next()->prev() = h_prev;
+    start = h->next();
+  }
+
+  if( o->face() != NULL ) {
+    Edge* o1 = o->next();
+    Edge* o2 = o1->next();
+    Edge* o1o = o1->opp();
+    Edge* o2o = o2->opp();
+    o1o->opp() = o2o;
+    o2o->opp() = o1o;
+    if( o1->vert()->edge() == o2 ) o1->vert()->edge() = o1o;
+    dead_edges.push_back(o1);
+    dead_edges.push_back(o2);
+    dead_faces.push_back(o->face());
+  }
+  else {
+    o_prev->next() = o->next();
+    o->next()->prev() = o_prev;
+  }
+  dead_edges.push_back(h);
+  dead_edges.push_back(o);
+
+  // boundary vertices keep their outgoing boundary edge
+  v->edge() = start;
+  e = start;
+  do {
+    if( e->face() == NULL ) { v->edge() = e; break; }
+    e = e->opp()->next();
+  } while( e != start );
+
+  return u;
+}
+
+bool MeshObj::_collapse_flips(Edge* h) const {
+  const Edge* o = h->opp();
+  const Vert* u = o->vert();
+  const Vec3f& pu = u->loc();
+  const Vec3f& pv = h->vert()->loc();
+
+  VertFaceRange ring = u->faces();
+  for( VertFaceRange::iterator f = ring.begin(); f != ring.end(); ++f ) {
+    if( *f == h->face() || *f == o->face() ) continue;
+    Edge* e = f.edge();
+    const Vec3f& p1 = e->vert()->loc();
+    const Vec3f& p2 = e->next()->vert()->loc();
+    Vec3f n_old = cross(p1 - pu, p2 - pu);
+    Vec3f n_new = cross(p1 - pv, p2 - pv);
+    if( n_old.dot(n_new) <= 0 ) return true;
+  }
+  return false;
+}
+
+void MeshObj::_purge(const std::vector<Edge*>& dead_edges,
+		     const std::vector<Face*>& dead_faces,
+		     const std::vector<Vert*>& dead_verts) {
+  std::vector<uint32_t> colors(dead_faces.size());
+  for( int i = 0; i < (int)dead_faces.size(); i++ ) {
+    Face* f = dead_faces[i];
+    colors[i] = _face_to_color[f];
+    _color_to_face.erase(colors[i]);
+    _face_to_color.erase(f);
+  }
+
+  take_out(_faces, dead_faces);
+  take_out(_edges, dead_edges);
+  take_out(_verts, dead_verts);
+
+  _journal_dispose(dead_edges, dead_faces, colors, dead_verts);
+}
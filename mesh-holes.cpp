@@ -0,0 +1,358 @@
+#include <cmath>
+#include "mesh.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Boundary loops and hole filling (after Liepa, "Filling holes in meshes"):
+// a minimum-area triangulation of the hole, optionally refined to the edge
+// lengths around the hole and faired
+
+namespace {
+
+  // larger holes are fanned around their centroid instead of triangulated
+  // by the O(n^3) search
+  const int MAX_SEARCH_EDGES = 256;
+
+  // rounds of umbrella smoothing when fairing
+  const int FAIR_ITERATIONS = 50;
+
+  float tri_area(const Vec3f& a, const Vec3f& b, const Vec3f& c) {
+    return 0.5f * cross(b - a, c - a).l2();
+  }
+
+  float angle_at(const Vec3f& apex, const Vec3f& a, const Vec3f& b) {
+    Vec3f u = a - apex, v = b - apex;
+    float l = u.l2() * v.l2();
+    if( l == 0 ) return 0;
+    return acos(std::max(-1.0f, std::min(1.0f, u.dot(v) / l)));
+  }
+
+  // mean length of the edges at v
+  float spacing(const Vert* v) {
+    float sum = 0;
+    int n = 0;
+    VertVertRange ring = v->neighbours();
+    for( VertVertRange::iterator w = ring.begin(); w != ring.end(); ++w, n++ )
+      sum += (w->loc() - v->loc()).l2();
+    return n == 0 ? 0 : sum / n;
+  }
+
+  // is the edge not Delaunay, i.e. do the opposite angles add up to more
+  // than pi? (with some slack, or cocircular corners flip back and forth)
+  bool not_delaunay(const Edge* e) {
+    const Vec3f& h = e->vert()->loc();
+    const Vec3f& t = e->opp()->vert()->loc();
+    return angle_at(e->next()->vert()->loc(), t, h)
+      + angle_at(e->opp()->next()->vert()->loc(), t, h) > M_PI + 1e-3;
+  }
+
+  void link_triangle(Face* f, Edge* a, Edge* b, Edge* c) {
+    a->next() = b;  b->next() = c;  c->next() = a;
+    a->prev() = c;  b->prev() = a;  c->prev() = b;
+    a->face() = b->face() = c->face() = f;
+    f->edge() = a;
+    f->normal() = f->calculate_normal();
+  }
+
+  // a new pair of half-edges between u and v; returns the one towards v
+  Edge* new_pair(Vert* u, Vert* v, std::vector<Edge*>& edges) {
+    Edge* uv = new Edge(v);
+    Edge* vu = new Edge(u);
+    uv->opp() = vu;
+    vu->opp() = uv;
+    edges.push_back(uv);
+    edges.push_back(vu);
+    return uv;
+  }
+
+  // splits the triangle at m into three
+  void split_triangle(Face* f, Vert* m, std::vector<Edge*>& edges,
+		      std::vector<Face*>& faces) {
+    Edge* e[3] = { f->edge(), f->edge()->next(), f->edge()->next()->next() };
+    Edge *to[3], *from[3];          // between e[i]->vert() and m
+    for( int i = 0; i < 3; i++ ) {
+      to[i] = new_pair(e[i]->vert(), m, edges);
+      from[i] = to[i]->opp();
+    }
+    m->edge() = from[0];
+    for( int i = 0; i < 3; i++ ) {
+      Face* g = f;
+      if( i > 0 ) {
+	g = new Face();
+	faces.push_back(g);
+      }
+      link_triangle(g, e[i], to[i], from[(i + 2) % 3]);
+    }
+  }
+
+  // one span of the triangulation: p[i]..p[j], closed by e from p[j] to p[i]
+  struct Span {
+    int i, j;
+    Edge* e;
+  };
+};
+
+void MeshObj::boundary_loops(std::vector<BoundaryLoop>& loops) {
+  index_elements();
+  loops.clear();
+  std::vector<char> seen(_edges.size(), 0);
+  for( EdgeItr i = _edges.begin(); i != _edges.end(); i++ ) {
+    if( (*i)->face() != NULL || seen[(*i)->index()] ) continue;
+    BoundaryLoop l;
+    l.edge = *i;
+    l.length = 0;
+    l.perimeter = 0;
+    Edge* e = *i;
+    do {
+      seen[e->index()] = 1;
+      l.length++;
+      l.perimeter += (e->vert()->loc() - e->opp()->vert()->loc()).l2();
+      e = e->next();
+    } while( e != *i );
+    loops.push_back(l);
+  }
+}
+
+int MeshObj::fill_holes(unsigned int max_edges, bool refine, bool fair) {
+  std::vector<BoundaryLoop> loops;
+  boundary_loops(loops);
+  std::vector<Edge*> holes;
+  for( int i = 0; i < (int)loops.size(); i++ )
+    if( loops[i].length >= 3 && (max_edges == 0 || loops[i].length <= max_edges) )
+      holes.push_back(loops[i].edge);
+  if( holes.empty() ) return 0;
+
+  JournalScope edit(this, true);
+  _reorder_after_edit();
+
+  // the borders, walked before the holes are closed
+  int n = holes.size();
+  std::vector<std::vector<Edge*> > borders(n);
+  for( int i = 0; i < n; i++ ) {
+    Edge* e = holes[i];
+    do { borders[i].push_back(e);  e = e->next(); } while( e != holes[i] );
+  }
+
+  // holes share no vertices, so each is filled on its own
+  std::vector<std::vector<Edge*> > edges(n);
+  std::vector<std::vector<Face*> > faces(n);
+  std::vector<std::vector<Vert*> > verts(n);
+  std::vector<char> filled(n, 0);
+#pragma omp parallel for schedule(dynamic)
+  for( int i = 0; i < n; i++ )
+    filled[i] = _fill_hole(holes[i], refine, fair, edges[i], faces[i], verts[i]);
+
+  int count = 0;
+  for( int i = 0; i < n; i++ ) {
+    if( !filled[i] ) continue;
+    count++;
+    _edges.insert(_edges.end(), edges[i].begin(), edges[i].end());
+    _verts.insert(_verts.end(), verts[i].begin(), verts[i].end());
+    for( int k = 0; k < (int)faces[i].size(); k++ ) {
+      _add_slot(faces[i][k], NULL);
+      _register_face(faces[i][k]);
+    }
+
+    // new vertices get the mean of the hole's border
+    std::vector<Vert*> border;
+    for( int k = 0; k < (int)borders[i].size(); k++ )
+      border.push_back(borders[i][k]->vert());
+    for( int k = 0; k < (int)verts[i].size(); k++ )
+      _add_slot(verts[i][k], &border[0], border.size());
+
+    // corners on the border take those of the faces beside the hole,
+    // corners at new vertices their mean
+    std::map<Vert*, Edge*> beside;
+    std::vector<int> beside_slots;
+    for( int k = 0; k < (int)borders[i].size(); k++ ) {
+      Edge* o = borders[i][k]->opp();
+      beside[o->vert()] = o;
+      beside_slots.push_back(o->slot());
+    }
+    Edge* inner = NULL;
+    for( int k = 0; k < (int)edges[i].size(); k++ ) {
+      Edge* x = edges[i][k];
+      std::map<Vert*, Edge*>::iterator b = beside.find(x->vert());
+      if( b != beside.end() ) _add_slot(x, b->second);
+      else if( inner != NULL ) _add_slot(x, inner);
+      else {
+	_add_slot(x, NULL);
+	_eprops.mean(x->slot(), &beside_slots[0], beside_slots.size());
+	inner = x;
+      }
+    }
+    for( int k = 0; k < (int)borders[i].size(); k++ ) {
+      Edge* x = borders[i][k];
+      _eprops.copy(x->slot(), beside[x->vert()]->slot());
+    }
+  }
+  return count;
+}
+
+bool MeshObj::_fill_hole(Edge* start, bool refine, bool fair,
+			 std::vector<Edge*>& new_edges,
+			 std::vector<Face*>& new_faces,
+			 std::vector<Vert*>& new_verts) {
+  // b[i] goes from p[i] to p[i+1]
+  std::vector<Edge*> b;
+  std::vector<Vert*> p;
+  Edge* e = start;
+  do {
+    b.push_back(e);
+    p.push_back(e->opp()->vert());
+    e = e->next();
+  } while( e != start );
+  int n = b.size();
+  if( n < 3 ) return false;
+
+  std::map<Vert*, float> sigma;
+  for( int i = 0; i < n; i++ ) sigma[p[i]] = spacing(p[i]);
+
+  if( n <= MAX_SEARCH_EDGES ) {
+    // loop vertices which are already joined may not get another edge
+    std::map<Vert*, int> pos;
+    for( int i = 0; i < n; i++ ) pos[p[i]] = i;
+    std::vector<char> joined(n * n, 0);
+    for( int i = 0; i < n; i++ ) {
+      VertVertRange ring = p[i]->neighbours();
+      for( VertVertRange::iterator w = ring.begin(); w != ring.end(); ++w ) {
+	std::map<Vert*, int>::iterator j = pos.find(*w);
+	if( j != pos.end() ) joined[i * n + j->second] = 1;
+      }
+    }
+
+    // area[i*n+j]: the smallest area of a triangulation of p[i]..p[j],
+    // best[i*n+j]: the third corner of the triangle on p[i],p[j]
+    std::vector<float> area(n * n, 0);
+    std::vector<int> best(n * n, -1);
+    for( int len = 2; len < n; len++ )
+      for( int i = 0; i + len < n; i++ ) {
+	int j = i + len;
+	area[i * n + j] = FLT_MAX;
+	if( joined[i * n + j] && !(i == 0 && j == n - 1) ) continue;
+	for( int k = i + 1; k < j; k++ ) {
+	  if( area[i * n + k] == FLT_MAX || area[k * n + j] == FLT_MAX ) continue;
+	  float a = area[i * n + k] + area[k * n + j]
+	    + tri_area(p[i]->loc(), p[k]->loc(), p[j]->loc());
+	  if( a < area[i * n + j] ) {
+	    area[i * n + j] = a;
+	    best[i * n + j] = k;
+	  }
+	}
+      }
+    if( best[n - 1] < 0 ) return false;
+
+    Span top = { 0, n - 1, b[n - 1] };
+    std::vector<Span> todo(1, top);
+    while( !todo.empty() ) {
+      Span s = todo.back();
+      todo.pop_back();
+      int k = best[s.i * n + s.j];
+      Edge* ik = b[s.i];
+      Edge* kj = b[k];
+      if( k > s.i + 1 ) {
+	ik = new_pair(p[s.i], p[k], new_edges);
+	Span l = { s.i, k, ik->opp() };
+	todo.push_back(l);
+      }
+      if( s.j > k + 1 ) {
+	kj = new_pair(p[k], p[s.j], new_edges);
+	Span r = { k, s.j, kj->opp() };
+	todo.push_back(r);
+      }
+      Face* f = new Face();
+      new_faces.push_back(f);
+      link_triangle(f, s.e, ik, kj);
+    }
+  }
+  else {
+    Vec3f c(0, 0, 0);
+    for( int i = 0; i < n; i++ ) c += p[i]->loc();
+    Vert* m = new Vert(c / (float)n);
+    new_verts.push_back(m);
+    std::vector<Edge*> to(n);       // from p[i] to m
+    for( int i = 0; i < n; i++ ) to[i] = new_pair(p[i], m, new_edges);
+    m->edge() = to[0]->opp();
+    float s = 0;
+    for( int i = 0; i < n; i++ ) {
+      Face* f = new Face();
+      new_faces.push_back(f);
+      link_triangle(f, b[i], to[(i + 1) % n], to[i]->opp());
+      s += sigma[p[i]];
+    }
+    sigma[m] = s / n;
+  }
+
+  if( refine ) {
+    // split triangles at their centroids until they are about as large as
+    // the edges around them, keeping the patch Delaunay
+    bool split = true;
+    while( split ) {
+      split = false;
+      int nf = new_faces.size();
+      for( int i = 0; i < nf; i++ ) {
+	Face* f = new_faces[i];
+	Vert* v[3];
+	Vec3f c(0, 0, 0);
+	float sc = 0;
+	int k = 0;
+	FaceVertRange r = f->verts();
+	for( FaceVertRange::iterator w = r.begin(); w != r.end(); ++w, k++ ) {
+	  v[k] = *w;
+	  c += w->loc();
+	  sc += sigma[*w];
+	}
+	c /= 3.0f;
+	sc /= 3.0f;
+
+	bool large = sc > 0;
+	for( k = 0; k < 3 && large; k++ ) {
+	  float d = (float)M_SQRT2 * (c - v[k]->loc()).l2();
+	  large = d > sc && d > sigma[v[k]];
+	}
+	if( !large ) continue;
+
+	Vert* m = new Vert(c);
+	new_verts.push_back(m);
+	sigma[m] = sc;
+	split_triangle(f, m, new_edges, new_faces);
+	split = true;
+      }
+
+      // the new edges are the ones with a face on both sides
+      for( bool flipped = true; flipped; ) {
+	flipped = false;
+	for( int i = 0; i < (int)new_edges.size(); i += 2 ) {
+	  Edge* x = new_edges[i];
+	  if( not_delaunay(x) && _flip_ok(x) ) {
+	    _edge_flip(x);
+	    flipped = true;
+	  }
+	}
+      }
+    }
+  }
+
+  if( fair && !new_verts.empty() ) {
+    // umbrella smoothing of the new vertices; the hole's border stays put
+    int nv = new_verts.size();
+    std::vector<Vec3f> pos(nv);
+    for( int it = 0; it < FAIR_ITERATIONS; it++ ) {
+      for( int i = 0; i < nv; i++ ) {
+	Vec3f q(0, 0, 0);
+	int k = 0;
+	VertVertRange ring = new_verts[i]->neighbours();
+	for( VertVertRange::iterator w = ring.begin(); w != ring.end(); ++w, k++ )
+	  q += w->loc();
+	pos[i] = q / (float)k;
+      }
+      for( int i = 0; i < nv; i++ ) new_verts[i]->loc() = pos[i];
+    }
+  }
+
+  for( int i = 0; i < (int)new_faces.size(); i++ )
+    new_faces[i]->normal() = new_faces[i]->calculate_normal();
+  for( int i = 0; i < n; i++ ) p[i]->normal() = p[i]->calculate_normal();
+  for( int i = 0; i < (int)new_verts.size(); i++ )
+    new_verts[i]->normal() = new_verts[i]->calculate_normal();
+  return true;
+}
@@ -0,0 +1,426 @@
+#include <exception>
+#include "mesh.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Undo/redo journal. An edit is recorded as the states of the elements it
+// touched, before and after, plus the elements it added and removed. Edits
+// of the whole mesh record every element (a snapshot).
+
+namespace {
+
+  // most edits kept for undo, and most elements and states they keep
+  // together (the last edit is kept however large)
+  const unsigned int MAX_RECORDS = 32;
+  const long MAX_ELEMENTS = 1L << 24;
+
+  struct EdgeState {
+    Edge *e, *next, *prev, *opp;
+    Face *face;
+    Vert *vert;
+
+    EdgeState(Edge* x)
+      : e(x), next(x->next()), prev(x->prev()), opp(x->opp()),
+	face(x->face()), vert(x->vert()) {  }
+    void restore(void) const {
+      e->next() = next;  e->prev() = prev;  e->opp() = opp;
+      e->face() = face;  e->vert() = vert;
+    }
+    bool same(const EdgeState& s) const {
+      return next == s.next && prev == s.prev && opp == s.opp
+	&& face == s.face && vert == s.vert;
+    }
+  };
+
+  struct VertState {
+    Vert *v;
+    Vec3f loc, normal;
+    Edge *edge;
+
+    VertState(Vert* x)
+      : v(x), loc(x->loc()), normal(x->normal()), edge(x->edge()) {  }
+    void restore(void) const {
+      v->loc() = loc;  v->normal() = normal;  v->edge() = edge;
+    }
+    bool same(const VertState& s) const {
+      return loc == s.loc && normal == s.normal && edge == s.edge;
+    }
+  };
+
+  struct FaceState {
+    Face *f;
+    Edge *edge;
+    Vec3f normal;
+
+    FaceState(Face* x) : f(x), edge(x->edge()), normal(x->normal()) {  }
+    void restore(void) const { f->edge() = edge;  f->normal() = normal; }
+    bool same(const FaceState& s) const {
+      return edge == s.edge && normal == s.normal;
+    }
+  };
+
+  template <class S>
+  void restore_all(const std::vector<S>& states) {
+    for( int i = 0; i < (int)states.size(); i++ ) states[i].restore();
+  }
+
+  template <class S>
+  bool all_same(const std::vector<S>& a, const std::vector<S>& b) {
+    for( int i = 0; i < (int)a.size(); i++ )
+      if( !a[i].same(b[i]) ) return false;
+    return true;
+  }
+
+  // takes the elements out of the container; they are usually its last ones
+  template <class T>
+  void detach(std::list<T*>& l, const std::vector<T*>& v) {
+    if( v.empty() ) return;
+    bool at_end = v.size() <= l.size();
+    typename std::list<T*>::iterator i = l.end();
+    for( int k = (int)v.size() - 1; at_end && k >= 0; k-- )
+      at_end = *(--i) == v[k];
+    if( at_end ) { l.erase(i, l.end());  return; }
+
+    std::set<T*> gone(v.begin(), v.end());
+    for( i = l.begin(); i != l.end(); )
+      if( gone.count(*i) ) i = l.erase(i);
+      else i++;
+  }
+
+  template <class T>
+  void attach(std::list<T*>& l, const std::vector<T*>& v) {
+    l.insert(l.end(), v.begin(), v.end());
+  }
+
+  template <class T>
+  void add_sorted(const std::list<T*>& l, std::vector<const void*>& out) {
+    out.insert(out.end(), l.begin(), l.end());
+  }
+  template <class T>
+  void add_sorted(const std::vector<T*>& v, std::vector<const void*>& out) {
+    out.insert(out.end(), v.begin(), v.end());
+  }
+  bool has(const std::vector<const void*>& sorted, const void* x) {
+    return std::binary_search(sorted.begin(), sorted.end(), x);
+  }
+};
+
+struct JournalRecord {
+  bool snapshot;
+  std::set<const void*> touched;        // elements with a state before
+  std::set<const void*> created;        // elements made by the edit
+  // A snapshot records every element; those which were there when the
+  // record became one are kept sorted instead of in sets, and new ones
+  // are not entered in created.
+  std::vector<const void*> existing;
+
+  std::vector<EdgeState> edges_before, edges_after;
+  // the corner values of edges_before (edited in place, unlike the values
+  // of vertices and faces); slot i for the i-th edge
+  const PropertySet* corners;
+  PropertySet corners_before, corners_after;
+  std::vector<VertState> verts_before, verts_after;
+  std::vector<FaceState> faces_before, faces_after;
+
+  std::vector<Edge*> added_edges, removed_edges;
+  std::vector<Vert*> added_verts, removed_verts;
+  std::vector<Face*> added_faces, removed_faces;
+  std::vector<uint32_t> added_colors, removed_colors;
+
+  // the states before are those of elements which existed before; made
+  // ones have none, and are destroyed again if the edit removes them
+  void touch(Edge* e) {
+    if( !created.count(e) && touched.insert(e).second ) {
+      edges_before.push_back(EdgeState(e));
+      corners_before.push(*corners, e->slot());
+    }
+  }
+  void touch(Vert* v) {
+    if( !created.count(v) && touched.insert(v).second ) verts_before.push_back(VertState(v));
+  }
+  void touch(Face* f) {
+    if( !created.count(f) && touched.insert(f).second ) faces_before.push_back(FaceState(f));
+  }
+
+  // whether the element was there when the edit began
+  bool existed(const void* x) const {
+    return !created.count(x) && (!snapshot || has(existing, x));
+  }
+
+  // the states, and the elements only a done record keeps
+  long size(void) const {
+    return edges_before.size() + edges_after.size() + verts_before.size()
+      + verts_after.size() + faces_before.size() + faces_after.size()
+      + removed_edges.size() + removed_verts.size() + removed_faces.size();
+  }
+
+  bool empty(void) const {
+    return added_edges.empty() && removed_edges.empty()
+      && added_verts.empty() && removed_verts.empty()
+      && added_faces.empty() && removed_faces.empty()
+      && all_same(edges_before, edges_after)
+      && all_same(verts_before, verts_after)
+      && all_same(faces_before, faces_after);
+  }
+};
+
+namespace {
+
+  // the elements at the end of the container which the edit made
+  template <class T>
+  void tail(const std::list<T*>& l, const JournalRecord& r,
+	    std::vector<T*>& out) {
+    typename std::list<T*>::const_iterator i = l.end();
+    while( i != l.begin() ) {
+      typename std::list<T*>::const_iterator k = i;
+      if( r.existed(*--k) ) break;
+      i = k;
+    }
+    out.assign(i, l.end());
+  }
+};
+
+MeshObj::JournalScope::JournalScope(MeshObj* m, bool snapshot, bool replaces)
+  : _mesh(m), _exceptions(std::uncaught_exceptions()) {
+  _mesh->_journal_begin(snapshot, replaces);
+}
+
+MeshObj::JournalScope::~JournalScope() {
+  _mesh->_journal_end(std::uncaught_exceptions() > _exceptions);
+}
+
+void MeshObj::set_journaling(bool on) {
+  _journaling = on;
+  if( !on ) clear_history();
+}
+
+void MeshObj::begin_edit(void) { _journal_begin(false); }
+void MeshObj::end_edit(void)   { _journal_end(); }
+
+bool MeshObj::can_undo(void) const { return !_undo.empty(); }
+bool MeshObj::can_redo(void) const { return !_redo.empty(); }
+
+bool MeshObj::undo(void) {
+  if( _undo.empty() || _record != NULL ) return false;
+  _version++;
+  JournalRecord* r = _undo.back();
+  _undo.pop_back();
+
+  for( int i = 0; i < (int)r->added_faces.size(); i++ ) {
+    _color_to_face.erase(r->added_colors[i]);
+    _face_to_color.erase(r->added_faces[i]);
+  }
+  detach(_faces, r->added_faces);
+  detach(_edges, r->added_edges);
+  detach(_verts, r->added_verts);
+
+  for( int i = 0; i < (int)r->removed_faces.size(); i++ ) {
+    _color_to_face[r->removed_colors[i]] = r->removed_faces[i];
+    _face_to_color[r->removed_faces[i]] = r->removed_colors[i];
+  }
+  attach(_faces, r->removed_faces);
+  attach(_edges, r->removed_edges);
+  attach(_verts, r->removed_verts);
+
+  restore_all(r->edges_before);
+  restore_all(r->verts_before);
+  restore_all(r->faces_before);
+  for( int i = 0; i < (int)r->edges_before.size(); i++ )
+    _eprops.put(r->edges_before[i].e->slot(), r->corners_before, i);
+
+  _redo.push_back(r);
+  return true;
+}
+
+bool MeshObj::redo(void) {
+  if( _redo.empty() || _record != NULL ) return false;
+  _version++;
+  JournalRecord* r = _redo.back();
+  _redo.pop_back();
+
+  for( int i = 0; i < (int)r->removed_faces.size(); i++ ) {
+    _color_to_face.erase(r->removed_colors[i]);
+    _face_to_color.erase(r->removed_faces[i]);
+  }
+  detach(_faces, r->removed_faces);
+  detach(_edges, r->removed_edges);
+  detach(_verts, r->removed_verts);
+
+  for( int i = 0; i < (int)r->added_faces.size(); i++ ) {
+    _color_to_face[r->added_colors[i]] = r->added_faces[i];
+    _face_to_color[r->added_faces[i]] = r->added_colors[i];
+  }
+  attach(_faces, r->added_faces);
+  attach(_edges, r->added_edges);
+  attach(_verts, r->added_verts);
+
+  restore_all(r->edges_after);
+  restore_all(r->verts_after);
+  restore_all(r->faces_after);
+  for( int i = 0; i < (int)r->edges_after.size(); i++ )
+    _eprops.put(r->edges_after[i].e->slot(), r->corners_after, i);
+
+  _undo.push_back(r);
+  return true;
+}
+
+void MeshObj::_journal_drop(JournalRecord* r, bool done) {
+  if( done ) _destroy(r->removed_edges, r->removed_faces, r->removed_verts);
+  else _destroy(r->added_edges, r->added_faces, r->added_verts);
+  delete r;
+}
+
+void MeshObj::clear_history(void) {
+  for( int i = 0; i < (int)_redo.size(); i++ ) _journal_drop(_redo[i], false);
+  for( int i = 0; i < (int)_undo.size(); i++ ) _journal_drop(_undo[i], true);
+  _redo.clear();
+  _undo.clear();
+}
+
+void MeshObj::_journal_begin(bool snapshot, bool replaces) {
+  _version++;
+  if( _edit_depth++ == 0 ) _reorder_pending = false;
+  if( !_journaling ) return;
+  if( _journal_depth++ == 0 ) {
+    _record = new JournalRecord();
+    _record->snapshot = false;
+    _record->corners = &_eprops;
+    _record->corners_before = _eprops.gather(std::vector<int>());
+  }
+  if( snapshot && !_record->snapshot ) {
+    // the states of the elements not touched yet; replace() changes none
+    JournalRecord* r = _record;
+    if( !replaces ) {
+      std::vector<int> slots;
+      for( EdgeItr i = _edges.begin(); i != _edges.end(); i++ )
+	if( !r->touched.count(*i) && !r->created.count(*i) ) {
+	  r->edges_before.push_back(EdgeState(*i));
+	  slots.push_back((*i)->slot());
+	}
+      r->corners_before.append(_eprops.gather(slots));
+      for( VertItr i = _verts.begin(); i != _verts.end(); i++ )
+	if( !r->touched.count(*i) && !r->created.count(*i) )
+	  r->verts_before.push_back(VertState(*i));
+      for( FaceItr i = _faces.begin(); i != _faces.end(); i++ )
+	if( !r->touched.count(*i) && !r->created.count(*i) )
+	  r->faces_before.push_back(FaceState(*i));
+    }
+    r->existing.reserve(_edges.size() + _verts.size() + _faces.size());
+    add_sorted(_edges, r->existing);
+    add_sorted(_verts, r->existing);
+    add_sorted(_faces, r->existing);
+    std::sort(r->existing.begin(), r->existing.end());
+    r->touched.clear();
+    r->snapshot = true;
+  }
+}
+
+void MeshObj::_journal_end(bool unwinding) {
+  // the reorder is nested in the edit, so it is undone with it
+  if( unwinding ) _reorder_pending = false;
+  if( _edit_depth == 1 && _reorder_pending && _auto_reorder ) {
+    _reorder_pending = false;
+    reorder();
+  }
+  _edit_depth--;
+  if( !_journaling || --_journal_depth > 0 ) return;
+  JournalRecord* r = _record;
+  _record = NULL;
+
+  // new elements are appended to the containers
+  tail(_edges, *r, r->added_edges);
+  tail(_verts, *r, r->added_verts);
+  tail(_faces, *r, r->added_faces);
+  for( int i = 0; i < (int)r->added_faces.size(); i++ )
+    r->added_colors.push_back(_face_to_color[r->added_faces[i]]);
+
+  // the states after of the elements which are still there; added
+  // elements need none, they are not changed while they are undone
+  std::vector<const void*> gone;
+  add_sorted(r->removed_edges, gone);
+  add_sorted(r->removed_verts, gone);
+  add_sorted(r->removed_faces, gone);
+  std::sort(gone.begin(), gone.end());
+  std::vector<int> slots;
+  for( int i = 0; i < (int)r->edges_before.size(); i++ )
+    if( !has(gone, r->edges_before[i].e) ) {
+      r->edges_after.push_back(EdgeState(r->edges_before[i].e));
+      slots.push_back(r->edges_before[i].e->slot());
+    }
+  r->corners_after = _eprops.gather(slots);
+  for( int i = 0; i < (int)r->verts_before.size(); i++ )
+    if( !has(gone, r->verts_before[i].v) )
+      r->verts_after.push_back(VertState(r->verts_before[i].v));
+  for( int i = 0; i < (int)r->faces_before.size(); i++ )
+    if( !has(gone, r->faces_before[i].f) )
+      r->faces_after.push_back(FaceState(r->faces_before[i].f));
+  r->touched.clear();
+  r->created.clear();
+  std::vector<const void*>().swap(r->existing);
+
+  if( r->empty() ) { delete r;  return; }
+
+  // a new edit drops the undone ones
+  for( int i = 0; i < (int)_redo.size(); i++ ) _journal_drop(_redo[i], false);
+  _redo.clear();
+
+  _undo.push_back(r);
+  long kept = 0;
+  for( int i = 0; i < (int)_undo.size(); i++ ) kept += _undo[i]->size();
+  while( _undo.size() > 1 && (_undo.size() > MAX_RECORDS || kept > MAX_ELEMENTS) ) {
+    kept -= _undo.front()->size();
+    _journal_drop(_undo.front(), true);
+    _undo.erase(_undo.begin());
+  }
+}
+
+void MeshObj::_journal_add(const void* element) {
+  if( _record != NULL && !_record->snapshot ) _record->created.insert(element);
+}
+
+void MeshObj::_journal_touch_face(Face* f) {
+  if( _record == NULL || _record->snapshot || f == NULL ) return;
+  _record->touch(f);
+  Edge* e = f->edge();
+  do {
+    _record->touch(e);
+    _record->touch(e->opp());
+    _record->touch(e->vert());
+    e = e->next();
+  } while( e != f->edge() );
+}
+
+void MeshObj::_journal_touch_ring(Vert* v) {
+  if( _record == NULL || _record->snapshot ) return;
+  _record->touch(v);
+  VertEdgeRange ring = v->edges();
+  for( VertEdgeRange::iterator e = ring.begin(); e != ring.end(); ++e ) {
+    _record->touch(*e);
+    _record->touch(e->opp());
+    _journal_touch_face(e->face());
+  }
+}
+
+void MeshObj::_journal_dispose(const std::vector<Edge*>& edges,
+			       const std::vector<Face*>& faces,
+			       const std::vector<uint32_t>& colors,
+			       const std::vector<Vert*>& verts) {
+  // elements which existed before the edit are kept for undo, elements
+  // the edit made and removed again are deleted
+  JournalRecord* r = _record;
+  std::vector<Edge*> de;
+  std::vector<Face*> df;
+  std::vector<Vert*> dv;
+  for( int i = 0; i < (int)faces.size(); i++ )
+    if( r != NULL && r->existed(faces[i]) ) {
+      r->removed_faces.push_back(faces[i]);
+      r->removed_colors.push_back(colors[i]);
+    }
+    else df.push_back(faces[i]);
+  for( int i = 0; i < (int)edges.size(); i++ )
+    if( r != NULL && r->existed(edges[i]) ) r->removed_edges.push_back(edges[i]);
+    else de.push_back(edges[i]);
+  for( int i = 0; i < (int)verts.size(); i++ )
+    if( r != NULL && r->existed(verts[i]) ) r->removed_verts.push_back(verts[i]);
+    else dv.push_back(verts[i]);
+  _destroy(de, df, dv);
+}
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cmath>
 #include "mesh-loader.h"
 
 /*
@@ -18,18 +20,6 @@
 //------------------------------------------------------------------
 namespace MeshLoad {
 
-  struct VTXindex_ltstr
-  {
-    bool operator()(VTXindex v1, VTXindex v2) const
-    {
-      if (v1.posIdx != v2.posIdx) return v1.posIdx<v2.posIdx;
-      if (v1.uvIdx  != v2.uvIdx) return v1.uvIdx<v2.uvIdx;
-      return v1.norIdx<v2.norIdx;
-    }
-  };
-
-  typedef std::map<VTXindex, int, VTXindex_ltstr> VTXmap;
-
   //------------------------------------------------------------------
   static void skipLine(std::istream& ifs);
   static bool skipCommentLine(std::istream& ifs);
@@ -146,6 +136,194 @@ namespace MeshLoad {
   }
 
 
+  namespace {
+    // the grid cell of a position as one key (21 bits per axis; cells
+    // which wrap around only share a key, distances are checked anyway)
+    unsigned long long cellKey(int x, int y, int z)
+    {
+      const unsigned long long mask = (1ULL << 21) - 1;
+      return ((x & mask) << 42) | ((y & mask) << 21) | (z & mask);
+    }
+
+    // the grid cell of a coordinate; far (or not finite) coordinates are
+    // clamped to cells which still fit an int when a neighbour is added
+    int cellOf(float x, float cell)
+    {
+      const double limit = 1 << 30;
+      double c = floor((double)x / cell);
+      if (!(c > -limit)) c = -limit;
+      if (c > limit) c = limit;
+      return (int)c;
+    }
+
+    // orders faces by their sorted corner positions (in keys, laid out
+    // like the faces), so that faces on the same vertices are adjacent
+    struct SameVertices
+    {
+      const std::vector<int>* keys;
+      const std::vector<unsigned int>* start;
+      unsigned int end(unsigned int f) const
+      {
+	return (f + 1 < start->size()) ? (*start)[f + 1] : keys->size();
+      }
+      bool operator()(unsigned int a, unsigned int b) const
+      {
+	unsigned int na = end(a) - (*start)[a], nb = end(b) - (*start)[b];
+	if (na != nb) return na < nb;
+	return std::lexicographical_compare(keys->begin() + (*start)[a],
+					    keys->begin() + end(a),
+					    keys->begin() + (*start)[b],
+					    keys->begin() + end(b));
+      }
+    };
+
+    struct KeyIndex
+    {
+      unsigned long long key;
+      int index;
+      bool operator<(const KeyIndex& k) const
+      {
+	return key < k.key || (key == k.key && index < k.index);
+      }
+    };
+  };
+
+  int weldOBJ(OBJMesh& mesh, float tolerance)
+  //------------------------------------------------------------------
+  {
+    int n = mesh.pos.size();
+    if (n == 0 || tolerance < 0) return 0;
+    float cell = (tolerance > 0) ? tolerance : 1;
+    float tol2 = tolerance * tolerance;
+
+    // positions sorted by grid cell; a vertex's match is in one of the 27
+    // cells around it
+    std::vector<int> cx(n), cy(n), cz(n);
+    std::vector<KeyIndex> sorted(n);
+#pragma omp parallel for
+    for (int i = 0; i < n; i++)
+      {
+	cx[i] = cellOf(mesh.pos[i].x(), cell);
+	cy[i] = cellOf(mesh.pos[i].y(), cell);
+	cz[i] = cellOf(mesh.pos[i].z(), cell);
+	sorted[i].key = cellKey(cx[i], cy[i], cz[i]);
+	sorted[i].index = i;
+      }
+    std::sort(sorted.begin(), sorted.end());
+
+    // each vertex goes to the first vertex within tolerance of it
+    std::vector<int> rep(n);
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (int i = 0; i < n; i++)
+      {
+	rep[i] = i;
+	for (int dx = -1; dx <= 1; dx++)
+	  for (int dy = -1; dy <= 1; dy++)
+	    for (int dz = -1; dz <= 1; dz++)
+	      {
+		KeyIndex k = { cellKey(cx[i] + dx, cy[i] + dy, cz[i] + dz), 0 };
+		std::vector<KeyIndex>::const_iterator j =
+		  std::lower_bound(sorted.begin(), sorted.end(), k);
+		for (; j != sorted.end() && j->key == k.key && j->index < rep[i]; j++)
+		  {
+		    Vec3 d = mesh.pos[j->index] - mesh.pos[i];
+		    if (d.dot(d) <= tol2) rep[i] = j->index;
+		  }
+	      }
+      }
+
+    // chains end at a vertex which stays (rep[i] <= i)
+    std::vector<int> newIdx(n);
+    std::vector<Vec3> pos;
+    for (int i = 0; i < n; i++)
+      {
+	rep[i] = rep[rep[i]];
+	if (rep[i] == i)
+	  {
+	    newIdx[i] = pos.size();
+	    pos.push_back(mesh.pos[i]);
+	  }
+	else newIdx[i] = newIdx[rep[i]];
+      }
+
+    // corners which repeat the previous one are dropped, and so are faces
+    // left with less than three or with a vertex twice, which would not be
+    // manifold
+    std::vector<VTXindex> faces;
+    std::vector<unsigned int> startidx;
+    std::vector<int> keys;
+    faces.reserve(mesh.faces.size());
+    startidx.reserve(mesh.face_startidx.size());
+    for (unsigned int f = 0; f < mesh.face_startidx.size(); f++)
+      {
+	unsigned int start = mesh.face_startidx[f];
+	unsigned int end = (f + 1 < mesh.face_startidx.size())
+	  ? mesh.face_startidx[f + 1] : mesh.faces.size();
+	unsigned int first = faces.size();
+	for (unsigned int j = start; j < end; j++)
+	  {
+	    VTXindex v = mesh.faces[j];
+	    v.posIdx = newIdx[v.posIdx];
+	    if (faces.size() > first && faces.back().posIdx == v.posIdx) continue;
+	    faces.push_back(v);
+	    keys.push_back(v.posIdx);
+	  }
+	while (faces.size() > first + 1 && faces.back().posIdx == faces[first].posIdx)
+	  {
+	    faces.pop_back();
+	    keys.pop_back();
+	  }
+	std::sort(keys.begin() + first, keys.end());
+	if (faces.size() - first < 3
+	    || std::adjacent_find(keys.begin() + first, keys.end()) != keys.end())
+	  {
+	    faces.resize(first);
+	    keys.resize(first);
+	  }
+	else startidx.push_back(first);
+      }
+
+    // of the faces on the same vertices (e.g. both sides of a double-sided
+    // surface) the first is kept
+    std::vector<unsigned int> order(startidx.size());
+    for (unsigned int f = 0; f < order.size(); f++) order[f] = f;
+    SameVertices same = { &keys, &startidx };
+    std::stable_sort(order.begin(), order.end(), same);
+    std::vector<char> twin(order.size(), 0);
+    for (unsigned int k = 1; k < order.size(); k++)
+      twin[order[k]] = !same(order[k - 1], order[k]);
+    std::vector<VTXindex> kept;
+    std::vector<unsigned int> keptidx;
+    kept.reserve(faces.size());
+    keptidx.reserve(startidx.size());
+    for (unsigned int f = 0; f < startidx.size(); f++)
+      {
+	if (twin[f]) continue;
+	keptidx.push_back(kept.size());
+	kept.insert(kept.end(), faces.begin() + startidx[f],
+		    faces.begin() + same.end(f));
+      }
+
+    // positions only dropped faces used would be vertices without edges
+    std::vector<int> used(pos.size(), -1);
+    for (unsigned int j = 0; j < kept.size(); j++) used[kept[j].posIdx] = 0;
+    std::vector<Vec3> usedPos;
+    for (unsigned int i = 0; i < pos.size(); i++)
+      if (used[i] == 0)
+	{
+	  used[i] = usedPos.size();
+	  usedPos.push_back(pos[i]);
+	}
+    for (unsigned int j = 0; j < kept.size(); j++)
+      kept[j].posIdx = used[kept[j].posIdx];
+
+    mesh.pos.swap(usedPos);
+    mesh.faces.swap(kept);
+    mesh.face_startidx.swap(keptidx);
+    return n - mesh.pos.size();
+  }
+
+
   void dumpMeshVerbose(const OBJMesh& mesh)
   //------------------------------------------------------------------
   {
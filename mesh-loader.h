@@ -55,6 +55,15 @@ namespace MeshLoad {
 
   struct OBJMesh* readOBJ(const char *filename);
 
+  // Merges the vertices closer than tolerance (0: equal positions only),
+  // found through a spatial hash, and drops the faces which collapse or
+  // are left with a vertex twice, and all but the first of the faces on
+  // the same vertices (such as the two sides of a double-sided STL). For
+  // files which repeat the vertices of every face (e.g. from STL). Texture
+  // coordinate and normal indices are kept. Returns the number of vertices
+  // removed: merged ones and those only dropped faces used.
+  int weldOBJ(OBJMesh& mesh, float tolerance);
+
   void dumpMeshVerbose(const OBJMesh& mesh);
 
 };
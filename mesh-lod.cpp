@@ -0,0 +1,237 @@
+#include "mesh-lod.h"
+#include "mesh-cache.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// class LODChain
+
+namespace {
+
+  typedef std::vector<int> Tris;   // 3 level-0 vertex ids per triangle
+
+  bool less_first(const pair<float, int>& a, const pair<float, int>& b) {
+    return a.first < b.first;
+  }
+
+  /* Moves the faces around pinched vertices (MeshObj::find_pinches) out
+   * of the slab, until the slab can be built as a manifold MeshObj.
+   */
+  void remove_pinches(Tris& slab, Tris& kept) {
+    while( true ) {
+      std::vector<int> ids(slab);
+      std::sort(ids.begin(), ids.end());
+      ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+      std::vector<int> corners(slab.size()), start;
+      for( int i = 0; i < (int)slab.size(); i++ )
+	corners[i] = std::lower_bound(ids.begin(), ids.end(), slab[i])
+	  - ids.begin();
+      for( int i = 0; i <= (int)slab.size(); i += 3 ) start.push_back(i);
+
+      std::vector<char> pinched;
+      if( !MeshObj::find_pinches(corners, start, ids.size(), pinched) )
+	return;
+
+      Tris rest;
+      for( int i = 0; i < (int)slab.size(); i += 3 ) {
+	bool pinch = pinched[corners[i]] || pinched[corners[i+1]]
+	  || pinched[corners[i+2]];
+	Tris& dst = pinch ? kept : rest;
+	dst.insert(dst.end(), slab.begin() + i, slab.begin() + i + 3);
+      }
+      slab.swap(rest);
+    }
+  }
+
+  /* decimates one slab on its own MeshObj, borders locked */
+  void decimate_slab(const std::vector<Vec3f>& pos, Tris& slab, float ratio,
+		     Tris& out) {
+    remove_pinches(slab, out);
+    if( slab.empty() ) return;
+
+    std::vector<int> ids(slab);
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+    MeshLoad::OBJMesh obj;
+    obj.pos.reserve(ids.size());
+    for( int i = 0; i < (int)ids.size(); i++ ) obj.pos.push_back(pos[ids[i]]);
+    obj.faces.reserve(slab.size());
+    obj.face_startidx.reserve(slab.size() / 3);
+    for( int i = 0; i < (int)slab.size(); i++ ) {
+      if( i % 3 == 0 ) obj.face_startidx.push_back(i);
+      int local = std::lower_bound(ids.begin(), ids.end(), slab[i]) - ids.begin();
+      obj.faces.push_back(MeshLoad::VTXindex(local, -1, -1));
+    }
+
+    MeshObj mesh(std::move(obj));
+
+    // vertices are never moved by decimation; remember where they came from
+    map<Vert*, int> id_of;
+    int n = 0;
+    for( list<Vert*>::const_iterator i = mesh.verts().begin();
+	 i != mesh.verts().end(); i++ )
+      id_of[*i] = ids[n++];
+
+    mesh.decimate((unsigned int)(slab.size() / 3 * ratio), FLT_MAX, true);
+
+    for( list<Face*>::const_iterator i = mesh.faces().begin();
+	 i != mesh.faces().end(); i++ ) {
+      Edge* e = (*i)->edge();
+      do { out.push_back(id_of[e->vert()]); e = e->next(); } while( e != (*i)->edge() );
+    }
+    mesh.clear();
+  }
+
+  /* one level coarser: the triangles are cut into slabs along the longest
+   * axis which are decimated in parallel. With shift, the slab borders are
+   * moved by half a slab so that the previous borders get decimated too.
+   */
+  void decimate_level(const std::vector<Vec3f>& pos, const Tris& tris,
+		      float ratio, int partitions, bool shift, Tris& out) {
+    out.clear();
+    int nt = tris.size() / 3;
+    if( nt == 0 ) return;
+
+    Vec3f lo = pos[tris[0]], hi = pos[tris[0]];
+    for( int i = 0; i < (int)tris.size(); i++ ) {
+      lo = lo.min(pos[tris[i]]);
+      hi = hi.max(pos[tris[i]]);
+    }
+    Vec3f ext = hi - lo;
+    int axis = (ext.x() > ext.y()) ? (ext.x() > ext.z() ? 0 : 2)
+                                   : (ext.y() > ext.z() ? 1 : 2);
+
+    std::vector< pair<float, int> > order(nt);
+    for( int i = 0; i < nt; i++ )
+      order[i] = pair<float, int>(pos[tris[3*i]](axis) + pos[tris[3*i+1]](axis)
+				  + pos[tris[3*i+2]](axis), i);
+    std::sort(order.begin(), order.end(), less_first);
+
+    if( partitions < 1 ) partitions = 1;
+    std::vector<Tris> slabs(partitions), results(partitions);
+    for( int i = 0; i < nt; i++ ) {
+      long offset = shift ? nt / 2 : 0;
+      Tris& slab = slabs[std::min(((long)i * partitions + offset) / nt,
+				  (long)partitions - 1)];
+      int t = order[i].second;
+      slab.insert(slab.end(), tris.begin() + 3*t, tris.begin() + 3*t + 3);
+    }
+
+#pragma omp parallel for schedule(dynamic)
+    for( int p = 0; p < partitions; p++ )
+      decimate_slab(pos, slabs[p], ratio, results[p]);
+
+    for( int p = 0; p < partitions; p++ )
+      out.insert(out.end(), results[p].begin(), results[p].end());
+  }
+};
+
+LODChain::LODChain() : _compact(false), _switch_distance(0)
+{  }
+
+void LODChain::build(MeshObj& mesh, int max_levels, float ratio,
+		     int partitions) {
+  clear();
+  if( mesh.faces().empty() ) return;
+
+  MeshLoad::OBJMesh obj;
+  mesh.to_obj(obj);
+  MeshObj base(std::move(obj));
+  base.convert_to_triangles();
+  base.index_elements();
+
+  std::vector<Vec3f> pos;
+  pos.reserve(base.verts().size());
+  _vertices.reserve(6 * base.verts().size());
+  float radius = 0;
+  for( list<Vert*>::const_iterator i = base.verts().begin();
+       i != base.verts().end(); i++ ) {
+    Vec3f n = (*i)->normal();
+    float len = n.l2();
+    if( len > 0 ) n /= len;
+    pos.push_back((*i)->loc());
+    _vertices.push_back((*i)->loc().x());
+    _vertices.push_back((*i)->loc().y());
+    _vertices.push_back((*i)->loc().z());
+    _vertices.push_back(n.x());
+    _vertices.push_back(n.y());
+    _vertices.push_back(n.z());
+    radius = std::max(radius, (*i)->loc().l2());
+  }
+  if( _switch_distance == 0 ) _switch_distance = 4 * radius;
+
+  Tris tris;
+  tris.reserve(3 * base.faces().size());
+  for( list<Face*>::const_iterator i = base.faces().begin();
+       i != base.faces().end(); i++ ) {
+    Edge* e = (*i)->edge();
+    do { tris.push_back(e->vert()->index()); e = e->next(); } while( e != (*i)->edge() );
+  }
+  base.clear();
+
+  _append_level(tris);
+  for( int level = 1; level < max_levels; level++ ) {
+    Tris coarser;
+    decimate_level(pos, tris, ratio, partitions, level % 2 == 0, coarser);
+    if( coarser.empty() || coarser.size() >= tris.size() ) break;
+    _append_level(coarser);
+    tris.swap(coarser);
+  }
+  // level 0 uses every vertex, so its order decides the fetch order
+  VertexCache::reorder_vertices(_vertices, 6, _indices);
+
+  if( _compact && !_vertices.empty() ) {
+    int n = _vertices.size() / 6;
+    _compact_vertices.encode(&_vertices[0], 6, n);
+    std::vector<float>().swap(_vertices);
+    _draw_normals.resize(3 * n);
+    _compact_vertices.decode_normals(0, n, &_draw_normals[0],
+				     _compact_vertices.step());
+  }
+}
+
+void LODChain::_append_level(const std::vector<int>& tris) {
+  Level l;
+  l.first = _indices.size();
+  l.count = tris.size();
+  l.acmr_before = l.acmr_after = 0;
+  _indices.insert(_indices.end(), tris.begin(), tris.end());
+  if( l.count > 0 ) {
+    unsigned int* t = &_indices[l.first];
+    l.acmr_before = VertexCache::acmr(t, l.count);
+    VertexCache::optimize(t, l.count, _vertices.size() / 6);
+    l.acmr_after = VertexCache::acmr(t, l.count);
+  }
+  _levels.push_back(l);
+}
+
+void LODChain::clear(void) {
+  _vertices.clear();
+  _compact_vertices.clear();
+  std::vector<GLshort>().swap(_draw_normals);
+  _indices.clear();
+  _levels.clear();
+}
+
+bool LODChain::empty(void) const { return _levels.empty(); }
+
+int LODChain::select(float distance) const {
+  int level = 0;
+  for( float d = _switch_distance; distance >= d && level + 1 < (int)_levels.size(); d *= 2 )
+    level++;
+  return level;
+}
+
+float& LODChain::switch_distance(void) { return _switch_distance; }
+
+void LODChain::set_compact(bool on) { _compact = on; }
+bool LODChain::compact(void) const { return _compact; }
+
+const std::vector<float>& LODChain::vertices(void) const { return _vertices; }
+const CompactVertices& LODChain::compact_vertices(void) const {
+  return _compact_vertices;
+}
+const std::vector<GLshort>& LODChain::draw_normals(void) const {
+  return _draw_normals;
+}
+const std::vector<unsigned int>& LODChain::indices(void) const { return _indices; }
+const std::vector<LODChain::Level>& LODChain::levels(void) const { return _levels; }
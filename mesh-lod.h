@@ -0,0 +1,71 @@
+#ifndef __MESH_LOD_H__
+#define __MESH_LOD_H__
+
+#include <vector>
+#include "mesh.h"
+#include "mesh-quantize.h"
+
+//-----------------------------------------------------------------------------
+
+/* A chain of progressively coarser triangle meshes. Coarser levels are
+ * built by quadric decimation, which never moves vertices, so every level
+ * indexes into the same vertex buffer (the vertices of level 0). Each
+ * level's triangles are ordered for the vertex cache (see mesh-cache.h).
+ */
+class LODChain {
+ public:
+  struct Level {
+    unsigned int first;   // offset into indices()
+    unsigned int count;   // number of indices (3 per triangle)
+    float acmr_before;    // vertex cache misses per triangle before and
+    float acmr_after;     // after the triangles were reordered
+  };
+
+  LODChain();
+
+  /* Builds up to max_levels levels, each with about ratio times the faces
+   * of the previous one. Each level is decimated as `partitions` spatial
+   * slabs in parallel, with the vertices on slab borders locked.
+   */
+  void build(MeshObj& mesh, int max_levels = 5, float ratio = 0.25,
+	     int partitions = 8);
+  void clear(void);
+  bool empty(void) const;
+
+  /* picks a level for a viewer at the given distance from the origin;
+   * level i is used from distance switch_distance() * 2^(i-1) on
+   */
+  int select(float distance) const;
+  float& switch_distance(void);
+
+  /* keeps the vertices as CompactVertices instead of floats, with their
+   * normals decoded once for drawing: 16 bytes a vertex instead of 24.
+   * Takes effect on the next build().
+   */
+  void set_compact(bool on);
+  bool compact(void) const;
+
+  // x,y,z,nx,ny,nz per vertex; empty when compact
+  const std::vector<float>& vertices(void) const;
+  // the same vertices when compact, empty otherwise
+  const CompactVertices& compact_vertices(void) const;
+  /* the normals of compact_vertices(), 3 snorm GLshorts a vertex, scaled
+   * to be drawn under its glScale(step()) with GL_NORMALIZE
+   */
+  const std::vector<GLshort>& draw_normals(void) const;
+  const std::vector<unsigned int>& indices(void) const;
+  const std::vector<Level>& levels(void) const;
+
+ private:
+  void _append_level(const std::vector<int>& tris);
+
+  std::vector<float> _vertices;
+  CompactVertices _compact_vertices;
+  std::vector<GLshort> _draw_normals;
+  bool _compact;
+  std::vector<unsigned int> _indices;
+  std::vector<Level> _levels;
+  float _switch_distance;
+};
+
+#endif
@@ -0,0 +1,136 @@
+#include <algorithm>
+#include "mesh-props.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// class PropertySet
+
+PropertySet::PropertySet() : _slots(0)
+{  }
+
+PropertySet::PropertySet(const PropertySet& s) : _slots(0) { *this = s; }
+
+PropertySet& PropertySet::operator=(const PropertySet& s) {
+  if( this == &s ) return *this;
+  for( Arrays::iterator i = _arrays.begin(); i != _arrays.end(); i++ )
+    delete i->second;
+  _arrays.clear();
+  for( Arrays::const_iterator i = s._arrays.begin(); i != s._arrays.end(); i++ )
+    _arrays[i->first] = i->second->clone();
+  _slots = s._slots;
+  _free = s._free;
+  return *this;
+}
+
+PropertySet::~PropertySet() {
+  for( Arrays::iterator i = _arrays.begin(); i != _arrays.end(); i++ )
+    delete i->second;
+}
+
+void PropertySet::swap(PropertySet& s) {
+  _arrays.swap(s._arrays);
+  std::swap(_slots, s._slots);
+  _free.swap(s._free);
+}
+
+void PropertySet::remove(const std::string& name) {
+  Arrays::iterator i = _arrays.find(name);
+  if( i == _arrays.end() ) return;
+  delete i->second;
+  _arrays.erase(i);
+}
+
+bool PropertySet::has(const std::string& name) const {
+  return _arrays.find(name) != _arrays.end();
+}
+
+std::vector<std::string> PropertySet::names(void) const {
+  std::vector<std::string> n;
+  for( Arrays::const_iterator i = _arrays.begin(); i != _arrays.end(); i++ )
+    n.push_back(i->first);
+  return n;
+}
+
+int PropertySet::slots(void) const { return _slots; }
+int PropertySet::used(void) const { return _slots - _free.size(); }
+
+int PropertySet::alloc(void) {
+  if( _free.empty() ) {
+    _slots++;
+    for( Arrays::iterator i = _arrays.begin(); i != _arrays.end(); i++ )
+      i->second->resize(_slots);
+    return _slots - 1;
+  }
+  int s = _free.back();
+  _free.pop_back();
+  for( Arrays::iterator i = _arrays.begin(); i != _arrays.end(); i++ )
+    i->second->reset(s);
+  return s;
+}
+
+void PropertySet::free(int slot) {
+  if( slot >= 0 ) _free.push_back(slot);
+}
+
+void PropertySet::resize(int n) {
+  _slots = n;
+  _free.clear();
+  for( Arrays::iterator i = _arrays.begin(); i != _arrays.end(); i++ )
+    i->second->resize(n);
+}
+
+void PropertySet::copy(int dst, int src) {
+  for( Arrays::iterator i = _arrays.begin(); i != _arrays.end(); i++ )
+    i->second->copy(dst, src);
+}
+
+void PropertySet::mean(int dst, const int* src, int n) {
+  if( n <= 0 ) return;
+  for( Arrays::iterator i = _arrays.begin(); i != _arrays.end(); i++ )
+    i->second->mean(dst, src, n);
+}
+
+PropertySet PropertySet::gather(const std::vector<int>& slot) const {
+  PropertySet s;
+  for( Arrays::const_iterator i = _arrays.begin(); i != _arrays.end(); i++ ) {
+    PropertyArray* a = i->second->empty_clone();
+    for( int k = 0; k < (int)slot.size(); k++ ) a->push_from(*i->second, slot[k]);
+    s._arrays[i->first] = a;
+  }
+  s._slots = slot.size();
+  return s;
+}
+
+int PropertySet::append(const PropertySet& s) {
+  int offset = _slots;
+  for( Arrays::const_iterator i = s._arrays.begin(); i != s._arrays.end(); i++ )
+    if( _arrays.find(i->first) == _arrays.end() ) {
+      PropertyArray* a = i->second->empty_clone();
+      a->resize(_slots);
+      _arrays[i->first] = a;
+    }
+
+  for( Arrays::iterator i = _arrays.begin(); i != _arrays.end(); i++ ) {
+    Arrays::const_iterator j = s._arrays.find(i->first);
+    if( j != s._arrays.end() ) i->second->append(*j->second);
+    else i->second->resize(_slots + s._slots);
+  }
+  _slots += s._slots;
+  for( int k = 0; k < (int)s._free.size(); k++ ) _free.push_back(s._free[k] + offset);
+  return offset;
+}
+
+void PropertySet::push(const PropertySet& s, int slot) {
+  for( Arrays::iterator i = _arrays.begin(); i != _arrays.end(); i++ ) {
+    Arrays::const_iterator j = s._arrays.find(i->first);
+    if( j != s._arrays.end() ) i->second->push_from(*j->second, slot);
+    else i->second->resize(_slots + 1);
+  }
+  _slots++;
+}
+
+void PropertySet::put(int dst, const PropertySet& s, int src) {
+  for( Arrays::iterator i = _arrays.begin(); i != _arrays.end(); i++ ) {
+    Arrays::const_iterator j = s._arrays.find(i->first);
+    if( j != s._arrays.end() ) i->second->put_from(dst, *j->second, src);
+  }
+}
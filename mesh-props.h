@@ -0,0 +1,182 @@
+#ifndef __MESH_PROPS_H__
+#define __MESH_PROPS_H__
+
+#include <map>
+#include <string>
+#include <vector>
+#include "cvec2t.h"
+#include "cvec3t.h"
+#include "cvec4t.h"
+
+//-----------------------------------------------------------------------------
+
+/* How the value of a new element is made from the elements it replaces:
+ * floating point scalars and vectors are averaged, values of other types
+ * are taken from the first element.
+ */
+template <class T> struct PropertyMean {
+  static T of(const T* const* v, int) { return *v[0]; }
+};
+
+template <class T> struct ArithmeticMean {
+  static T of(const T* const* v, int n) {
+    T sum = *v[0];
+    for( int i = 1; i < n; i++ ) sum += *v[i];
+    return sum / n;
+  }
+};
+
+template <> struct PropertyMean<float>  : ArithmeticMean<float>  {  };
+template <> struct PropertyMean<double> : ArithmeticMean<double> {  };
+template <> struct PropertyMean<CVec2T<float> > : ArithmeticMean<CVec2T<float> > {  };
+template <> struct PropertyMean<CVec3T<float> > : ArithmeticMean<CVec3T<float> > {  };
+template <> struct PropertyMean<CVec4T<float> > : ArithmeticMean<CVec4T<float> > {  };
+
+//-----------------------------------------------------------------------------
+
+/* the type-independent interface of Property<T> */
+class PropertyArray {
+ public:
+  virtual ~PropertyArray() {  }
+  virtual PropertyArray* clone(void) const = 0;
+  // an empty array of the same type and default
+  virtual PropertyArray* empty_clone(void) const = 0;
+
+  virtual void resize(int n) = 0;
+  virtual void reset(int slot) = 0;                    // to the default
+  virtual void copy(int dst, int src) = 0;
+  virtual void mean(int dst, const int* src, int n) = 0;
+  // appends the values of a (which must be of the same type)
+  virtual void append(const PropertyArray& a) = 0;
+  // appends the value of a at slot
+  virtual void push_from(const PropertyArray& a, int slot) = 0;
+  // sets dst to the value of a at src
+  virtual void put_from(int dst, const PropertyArray& a, int src) = 0;
+};
+
+/* One value of type T per slot, in one contiguous array. Index it with
+ * the slot of an element, or with the element itself: uv[v] is
+ * uv[v->slot()].
+ */
+template <class T>
+class Property : public PropertyArray {
+ public:
+  Property(const T& def) : _default(def) {  }
+
+  T& operator[](int slot)             { return _data[slot]; }
+  const T& operator[](int slot) const { return _data[slot]; }
+  template <class E> T& operator[](const E* e)             { return _data[e->slot()]; }
+  template <class E> const T& operator[](const E* e) const { return _data[e->slot()]; }
+
+  // the values of all slots, free ones included
+  T* data(void)             { return _data.empty() ? NULL : &_data[0]; }
+  const T* data(void) const { return _data.empty() ? NULL : &_data[0]; }
+  const T& default_value(void) const { return _default; }
+
+  PropertyArray* clone(void) const { return new Property<T>(*this); }
+  PropertyArray* empty_clone(void) const { return new Property<T>(_default); }
+
+  void resize(int n) { _data.resize(n, _default); }
+  void reset(int slot) { _data[slot] = _default; }
+  void copy(int dst, int src) { _data[dst] = _data[src]; }
+  void mean(int dst, const int* src, int n) {
+    std::vector<const T*> v(n);
+    for( int i = 0; i < n; i++ ) v[i] = &_data[src[i]];
+    _data[dst] = PropertyMean<T>::of(&v[0], n);
+  }
+  void append(const PropertyArray& a) {
+    const std::vector<T>& d = _cast(a)._data;
+    _data.insert(_data.end(), d.begin(), d.end());
+  }
+  void push_from(const PropertyArray& a, int slot) {
+    _data.push_back(_cast(a)._data[slot]);
+  }
+  void put_from(int dst, const PropertyArray& a, int src) {
+    _data[dst] = _cast(a)._data[src];
+  }
+
+ private:
+  static const Property<T>& _cast(const PropertyArray& a) {
+    const Property<T>* p = dynamic_cast<const Property<T>*>(&a);
+    if( p == NULL ) throw "Property<T>::_cast(const PropertyArray&): type mismatch.";
+    return *p;
+  }
+
+  std::vector<T> _data;
+  T _default;
+};
+
+//-----------------------------------------------------------------------------
+
+/* The named properties of one kind of element and the slots they are
+ * indexed by. Slots of deleted elements are reused.
+ */
+class PropertySet {
+ public:
+  PropertySet();
+  PropertySet(const PropertySet& s);
+  PropertySet& operator=(const PropertySet& s);
+  ~PropertySet();
+  void swap(PropertySet& s);
+
+  /* Adds a property (every slot gets def) and returns it; returns the one
+   * there is if the name is taken by a property of the same type.
+   */
+  template <class T> Property<T>& add(const std::string& name,
+				      const T& def = T());
+  /* NULL if there is no such property of type T */
+  template <class T> Property<T>* get(const std::string& name);
+  void remove(const std::string& name);
+  bool has(const std::string& name) const;
+  std::vector<std::string> names(void) const;
+
+  int slots(void) const;            // used and free
+  int used(void) const;
+  int alloc(void);                  // a slot with the default values
+  void free(int slot);
+  void resize(int n);               // slots 0..n-1 used, none free
+  void copy(int dst, int src);
+  void mean(int dst, const int* src, int n);
+
+  /* a set with the same properties whose slot i holds slot[i] of this */
+  PropertySet gather(const std::vector<int>& slot) const;
+  /* Appends the slots of s (whose properties of the same name must have
+   * the same types), adding the properties this set lacks. Returns the
+   * offset the slots of s were moved by.
+   */
+  int append(const PropertySet& s);
+  /* appends slot of s as a new slot (the properties of s must be those of
+   * this set); sets slot dst to slot src of s
+   */
+  void push(const PropertySet& s, int slot);
+  void put(int dst, const PropertySet& s, int src);
+
+ private:
+  typedef std::map<std::string, PropertyArray*> Arrays;
+  Arrays _arrays;
+  int _slots;
+  std::vector<int> _free;
+};
+
+template <class T>
+Property<T>& PropertySet::add(const std::string& name, const T& def) {
+  Arrays::iterator i = _arrays.find(name);
+  if( i != _arrays.end() ) {
+    Property<T>* p = dynamic_cast<Property<T>*>(i->second);
+    if( p == NULL )
+      throw "PropertySet::add(const std::string&, const T&): name taken by another type.";
+    return *p;
+  }
+  Property<T>* p = new Property<T>(def);
+  p->resize(_slots);
+  _arrays[name] = p;
+  return *p;
+}
+
+template <class T>
+Property<T>* PropertySet::get(const std::string& name) {
+  Arrays::iterator i = _arrays.find(name);
+  return (i == _arrays.end()) ? NULL : dynamic_cast<Property<T>*>(i->second);
+}
+
+#endif
@@ -0,0 +1,131 @@
+#include <cmath>
+#include "mesh-quantize.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Octahedral normals (Meyer et al., "On Floating-Point Normal Vectors"): the
+// unit sphere is projected onto the octahedron |x|+|y|+|z| = 1, whose lower
+// half is folded out over the corners of the square of its upper half
+
+namespace {
+
+  const float SNORM = 32767;
+
+  float sign(float x) { return (x >= 0) ? 1 : -1; }
+
+  void oct_encode(float x, float y, float z, GLshort* e) {
+    float s = fabs(x) + fabs(y) + fabs(z);
+    if( s == 0 ) { e[0] = e[1] = 0;  return; }   // decodes as +z
+    float u = x / s, v = y / s;
+    if( z < 0 ) {
+      float fu = (1 - fabs(v)) * sign(u);
+      v = (1 - fabs(u)) * sign(v);
+      u = fu;
+    }
+    e[0] = (GLshort)lrintf(u * SNORM);
+    e[1] = (GLshort)lrintf(v * SNORM);
+  }
+
+  // unnormalized
+  Vec3f oct_decode(const GLshort* e) {
+    float u = e[0] / SNORM, v = e[1] / SNORM;
+    float z = 1 - fabs(u) - fabs(v);
+    float t = std::max(-z, 0.0f);
+    return Vec3f(u - t * sign(u), v - t * sign(v), z);
+  }
+
+  // a unit coordinate as it is stored
+  inline void put(float x, float& out)   { out = x; }
+  inline void put(float x, GLshort& out) {
+    out = (GLshort)(x * SNORM + copysignf(0.5f, x));
+  }
+
+  // branch-free so that it vectorizes
+  template <class T>
+  void decode(const GLshort* e, int count, T* out, const Vec3f& scale) {
+    const float sx = scale.x(), sy = scale.y(), sz = scale.z();
+#pragma omp parallel for simd
+    for( int i = 0; i < count; i++ ) {
+      float u = e[2 * i] * (1 / SNORM), v = e[2 * i + 1] * (1 / SNORM);
+      float z = 1 - fabsf(u) - fabsf(v);
+      float t = std::max(-z, 0.0f);
+      u -= copysignf(t, u);
+      v -= copysignf(t, v);
+      u *= sx;  v *= sy;  z *= sz;
+      float r = 1 / sqrtf(u * u + v * v + z * z);
+      put(u * r, out[3 * i]);
+      put(v * r, out[3 * i + 1]);
+      put(z * r, out[3 * i + 2]);
+    }
+  }
+};
+
+CompactVertices::CompactVertices() : _origin(0, 0, 0), _step(1, 1, 1)
+{  }
+
+void CompactVertices::encode(const float* vertices, int stride, int count) {
+  clear();
+  if( count <= 0 ) return;
+
+  Vec3f lo(vertices), hi(vertices);
+  for( int i = 1; i < count; i++ ) {
+    lo = lo.min(Vec3f(vertices + i * stride));
+    hi = hi.max(Vec3f(vertices + i * stride));
+  }
+  // 65535 steps across the box, stored less 32768 to fit GL_SHORT; a flat
+  // axis gets step 1 so that glScale() stays invertible
+  for( int k = 0; k < 3; k++ ) {
+    _step(k) = (hi(k) > lo(k)) ? (hi(k) - lo(k)) / 65535 : 1;
+    _origin(k) = lo(k) + 32768 * _step(k);
+  }
+
+  _positions.resize(3 * count);
+  _normals.resize(2 * count);
+#pragma omp parallel for
+  for( int i = 0; i < count; i++ ) {
+    const float* v = vertices + i * stride;
+    for( int k = 0; k < 3; k++ ) {
+      long q = lrintf((v[k] - lo(k)) / _step(k));
+      _positions[3 * i + k] = (GLshort)(std::min(std::max(q, 0L), 65535L) - 32768);
+    }
+    oct_encode(v[3], v[4], v[5], &_normals[2 * i]);
+  }
+}
+
+void CompactVertices::clear(void) {
+  std::vector<GLshort>().swap(_positions);
+  std::vector<GLshort>().swap(_normals);
+  _origin = Vec3f(0, 0, 0);
+  _step = Vec3f(1, 1, 1);
+}
+
+bool CompactVertices::empty(void) const { return _normals.empty(); }
+int CompactVertices::size(void) const { return _normals.size() / 2; }
+
+Vec3f CompactVertices::position(int i) const {
+  const GLshort* q = &_positions[3 * i];
+  return Vec3f(_origin.x() + _step.x() * q[0],
+	       _origin.y() + _step.y() * q[1],
+	       _origin.z() + _step.z() * q[2]);
+}
+
+Vec3f CompactVertices::normal(int i) const {
+  Vec3f n = oct_decode(&_normals[2 * i]);
+  return n / n.l2();
+}
+
+void CompactVertices::decode_normals(int first, int count, float* out,
+				     const Vec3f& scale) const {
+  if( count > 0 ) decode(&_normals[2 * first], count, out, scale);
+}
+
+void CompactVertices::decode_normals(int first, int count, GLshort* out,
+				     const Vec3f& scale) const {
+  if( count > 0 ) decode(&_normals[2 * first], count, out, scale);
+}
+
+const GLshort* CompactVertices::positions(void) const {
+  return _positions.empty() ? NULL : &_positions[0];
+}
+
+const Vec3f& CompactVertices::origin(void) const { return _origin; }
+const Vec3f& CompactVertices::step(void) const { return _step; }
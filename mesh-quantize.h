@@ -0,0 +1,56 @@
+#ifndef __MESH_QUANTIZE_H__
+#define __MESH_QUANTIZE_H__
+
+#include <vector>
+#include "mesh.h"
+
+//-----------------------------------------------------------------------------
+
+/* Compact vertex storage: positions quantized to 16 bits a coordinate
+ * within their bounding box, unit normals octahedral-encoded in two 16-bit
+ * snorms. 10 bytes a vertex instead of 24 for x,y,z,nx,ny,nz floats; the
+ * position error is at most half a step, the normal error below 0.05
+ * degrees.
+ */
+class CompactVertices {
+ public:
+  CompactVertices();
+
+  /* encodes count vertices, each x,y,z,nx,ny,nz at the start of stride
+   * floats; normals need not be of unit length
+   */
+  void encode(const float* vertices, int stride, int count);
+  void clear(void);
+  bool empty(void) const;
+  int size(void) const;
+
+  // dequantized on read
+  Vec3f position(int i) const;
+  Vec3f normal(int i) const;
+
+  /* Decodes the unit normals of vertices first..first+count-1 into out,
+   * 3 floats (or 3 snorm GLshorts, as glNormalPointer() takes them) each,
+   * in parallel and vectorized. Each is multiplied by scale
+   * (componentwise) before it is normalized; see step().
+   */
+  void decode_normals(int first, int count, float* out,
+		      const Vec3f& scale = Vec3f(1, 1, 1)) const;
+  void decode_normals(int first, int count, GLshort* out,
+		      const Vec3f& scale = Vec3f(1, 1, 1)) const;
+
+  /* The quantized positions, 3 GL_SHORTs a vertex; a position is origin()
+   * + step() * q componentwise. Drawn under glTranslate(origin()) and
+   * glScale(step()), the normals must be scaled by step() to come out
+   * right after GL_NORMALIZE.
+   */
+  const GLshort* positions(void) const;
+  const Vec3f& origin(void) const;
+  const Vec3f& step(void) const;
+
+ private:
+  std::vector<GLshort> _positions;
+  std::vector<GLshort> _normals;       // 2 a vertex
+  Vec3f _origin, _step;
+};
+
+#endif
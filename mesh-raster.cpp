@@ -0,0 +1,270 @@
+#include <cmath>
+#include <fstream>
+#include <omp.h>
+#include "mesh-raster.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// class Rasterizer: triangles are set up and binned to 64x64 pixel tiles by
+// each thread for its share of the faces, then the tiles are filled in
+// parallel, each going through the bins in face order
+
+namespace {
+
+  const int TILE = 64;
+  const float AMBIENT = 0.2;        // OpenGL's default light model ambient
+
+  /* GL_LIGHT0 and GL_LIGHT1 of Draw::draw_scene() shine along z and -z
+   * with diffuse white; no specular, as color material leaves it black
+   */
+  Vec3f lit(const Vec3f& color, const Vec3f& normal) {
+    float len = normal.l2();
+    float diffuse = (len > 0) ? fabs(normal.z()) / len : 0;
+    return (color * (AMBIENT + diffuse)).min(Vec3f(1, 1, 1));
+  }
+
+  HMatrix<float> look_at(const Vec3f& eye) {
+    Vec3f f = -eye / eye.l2(), up(0, 1, 0);
+    Vec3f s = cross(f, up);
+    s /= s.l2();
+    Vec3f u = cross(s, f);
+    return HMatrix<float>( s.x(),  s.y(),  s.z(), -s.dot(eye),
+			   u.x(),  u.y(),  u.z(), -u.dot(eye),
+			  -f.x(), -f.y(), -f.z(),  f.dot(eye),
+			   0,      0,      0,      1);
+  }
+
+  HMatrix<float> perspective(float fov, float aspect, float znear, float zfar) {
+    float f = 1 / tan(fov * M_PI / 360);
+    return HMatrix<float>(f / aspect, 0, 0, 0,
+			  0, f, 0, 0,
+			  0, 0, (zfar + znear) / (znear - zfar),
+			  2 * zfar * znear / (znear - zfar),
+			  0, 0, -1, 0);
+  }
+
+  // > 0 when p is left of a->b
+  float edge(float ax, float ay, float bx, float by, float px, float py) {
+    return (bx - ax) * (py - ay) - (by - ay) * (px - ax);
+  }
+
+  // pixels on an edge belong to the triangle left of it if it is a top or
+  // left edge (counter-clockwise, y up), so shared edges are filled once
+  bool owns(float ax, float ay, float bx, float by) {
+    return by < ay || (by == ay && bx < ax);
+  }
+
+  GLubyte to_byte(float c) { return (GLubyte)(std::min(c, 1.0f) * 255 + 0.5f); }
+};
+
+Rasterizer::Camera::Camera()
+  : position(5, 5, 5), fov(40), znear(1), zfar(100)
+{  }
+
+Rasterizer::Rasterizer(int width, int height)
+  : _width(width), _height(height), _pixels(4 * width * height),
+    _depth(width * height)
+{  }
+
+void Rasterizer::draw_scene(MeshObj& mesh, const Camera& camera,
+			    const Vec3f& color, bool vertex_normals) {
+  _draw(mesh, camera, color, vertex_normals, false);
+}
+
+void Rasterizer::draw_selectable(MeshObj& mesh, const Camera& camera) {
+  _draw(mesh, camera, Vec3f(0, 0, 0), false, true);
+}
+
+void Rasterizer::_draw(MeshObj& mesh, const Camera& camera, const Vec3f& color,
+		       bool vertex_normals, bool ids) {
+  mesh.index_elements();
+  std::vector<Vert*> verts(mesh.verts().begin(), mesh.verts().end());
+  std::vector<Face*> faces(mesh.faces().begin(), mesh.faces().end());
+  int nv = verts.size(), nf = faces.size();
+
+  HMatrix<float> mvp =
+    perspective(camera.fov, _width / (float)_height, camera.znear, camera.zfar)
+    * look_at(camera.position) * camera.rotation;
+  std::vector<Vec4f> clip(nv);
+#pragma omp parallel for
+  for( int i = 0; i < nv; i++ ) clip[i] = mvp * Vec4f(verts[i]->loc(), 1);
+
+  int ntx = (_width + TILE - 1) / TILE, nty = (_height + TILE - 1) / TILE;
+  int nthreads = omp_get_max_threads();
+  std::vector< std::vector<Triangle> > tris(nthreads);
+  std::vector< std::vector< std::vector<int> > > bins(nthreads);
+
+#pragma omp parallel num_threads(nthreads)
+  {
+    int t = omp_get_thread_num();
+    std::vector<Triangle>& mine = tris[t];
+    // static: each thread takes one run of faces, in thread order
+#pragma omp for schedule(static)
+    for( int i = 0; i < nf; i++ ) {
+      Face* f = faces[i];
+      uint32_t id = ids ? mesh.face_to_color(f) : 0;
+      Vec3f face_color = lit(color, camera.rotation * Vec4f(f->normal(), 0));
+      Corner c[3];
+      Edge* e0 = f->edge();
+      for( Edge* e = e0->next(); e->next() != e0; e = e->next() ) {
+	Edge* fan[3] = { e0, e, e->next() };
+	for( int k = 0; k < 3; k++ ) {
+	  c[k].clip = clip[fan[k]->vert()->index()];
+	  c[k].color = vertex_normals ?
+	    lit(color, camera.rotation * Vec4f(fan[k]->vert()->normal(), 0))
+	    : face_color;
+	}
+	_setup(c, id, mine);
+      }
+    }
+
+    bins[t].resize(ntx * nty);
+    for( int i = 0; i < (int)mine.size(); i++ ) {
+      const Triangle& r = mine[i];
+      float lox = std::min(r.x[0], std::min(r.x[1], r.x[2]));
+      float hix = std::max(r.x[0], std::max(r.x[1], r.x[2]));
+      float loy = std::min(r.y[0], std::min(r.y[1], r.y[2]));
+      float hiy = std::max(r.y[0], std::max(r.y[1], r.y[2]));
+      int tx0 = std::max(0, (int)floor(lox / TILE));
+      int tx1 = std::min(ntx - 1, (int)floor(hix / TILE));
+      int ty0 = std::max(0, (int)floor(loy / TILE));
+      int ty1 = std::min(nty - 1, (int)floor(hiy / TILE));
+      for( int ty = ty0; ty <= ty1; ty++ )
+	for( int tx = tx0; tx <= tx1; tx++ ) bins[t][ty * ntx + tx].push_back(i);
+    }
+  }
+
+  std::fill(_pixels.begin(), _pixels.end(), 0);
+  std::fill(_depth.begin(), _depth.end(), 1.0f);
+#pragma omp parallel for schedule(dynamic)
+  for( int tile = 0; tile < ntx * nty; tile++ ) _fill(tile, tris, bins, ids);
+}
+
+void Rasterizer::_setup(const Corner* c, uint32_t id,
+			std::vector<Triangle>& out) const {
+  // clipped to the near plane, z >= -w; the rest is left to the tiles
+  Corner poly[4];
+  int n = 0;
+  for( int k = 0; k < 3; k++ ) {
+    const Corner& a = c[k];
+    const Corner& b = c[(k + 1) % 3];
+    float da = a.clip.z() + a.clip.w(), db = b.clip.z() + b.clip.w();
+    if( da >= 0 ) poly[n++] = a;
+    if( (da >= 0) != (db >= 0) ) {
+      float s = da / (da - db);
+      poly[n].clip = a.clip + (b.clip - a.clip) * s;
+      poly[n].color = a.color + (b.color - a.color) * s;
+      n++;
+    }
+  }
+
+  for( int k = 1; k + 1 < n; k++ ) {
+    const Corner* fan[3] = { &poly[0], &poly[k], &poly[k + 1] };
+    Triangle r;
+    for( int j = 0; j < 3; j++ ) {
+      const Vec4f& p = fan[j]->clip;
+      r.w[j] = 1 / p.w();
+      r.x[j] = (p.x() * r.w[j] * 0.5f + 0.5f) * _width;
+      r.y[j] = (p.y() * r.w[j] * 0.5f + 0.5f) * _height;
+      r.z[j] = p.z() * r.w[j] * 0.5f + 0.5f;
+      r.color[j] = fan[j]->color;
+    }
+    r.id = id;
+    out.push_back(r);
+  }
+}
+
+void Rasterizer::_fill(int tile, const std::vector< std::vector<Triangle> >& tris,
+		       const std::vector< std::vector< std::vector<int> > >& bins,
+		       bool ids) {
+  int ntx = (_width + TILE - 1) / TILE;
+  int x0 = tile % ntx * TILE, y0 = tile / ntx * TILE;
+  int x1 = std::min(x0 + TILE, _width), y1 = std::min(y0 + TILE, _height);
+
+  for( int t = 0; t < (int)bins.size(); t++ )
+    for( int b = 0; b < (int)bins[t][tile].size(); b++ ) {
+      const Triangle& r = tris[t][bins[t][tile][b]];
+      // both sides are drawn: clockwise triangles are walked backwards
+      float area = edge(r.x[0], r.y[0], r.x[1], r.y[1], r.x[2], r.y[2]);
+      if( area == 0 ) continue;
+      int v[3] = { 0, 1, 2 };
+      if( area < 0 ) { std::swap(v[1], v[2]);  area = -area; }
+      bool own[3];
+      for( int k = 0; k < 3; k++ ) {
+	int a = v[(k + 1) % 3], c = v[(k + 2) % 3];
+	own[k] = owns(r.x[a], r.y[a], r.x[c], r.y[c]);
+      }
+
+      // pixel centers within the bounding box and the tile
+      float lox = std::min(r.x[0], std::min(r.x[1], r.x[2]));
+      float hix = std::max(r.x[0], std::max(r.x[1], r.x[2]));
+      float loy = std::min(r.y[0], std::min(r.y[1], r.y[2]));
+      float hiy = std::max(r.y[0], std::max(r.y[1], r.y[2]));
+      int px0 = std::max(x0, (int)ceil(lox - 0.5f));
+      int px1 = std::min(x1 - 1, (int)floor(hix - 0.5f));
+      int py0 = std::max(y0, (int)ceil(loy - 0.5f));
+      int py1 = std::min(y1 - 1, (int)floor(hiy - 0.5f));
+
+      for( int py = py0; py <= py1; py++ )
+	for( int px = px0; px <= px1; px++ ) {
+	  float x = px + 0.5f, y = py + 0.5f;
+	  float l[3];
+	  bool inside = true;
+	  for( int k = 0; k < 3 && inside; k++ ) {
+	    int a = v[(k + 1) % 3], c = v[(k + 2) % 3];
+	    l[k] = edge(r.x[a], r.y[a], r.x[c], r.y[c], x, y);
+	    inside = l[k] > 0 || (l[k] == 0 && own[k]);
+	  }
+	  if( !inside ) continue;
+
+	  float z = 0;
+	  for( int k = 0; k < 3; k++ ) z += l[k] / area * r.z[v[k]];
+	  float& depth = _depth[py * _width + px];
+	  if( z > 1 || z >= depth ) continue;
+	  depth = z;
+
+	  GLubyte* p = &_pixels[4 * (py * _width + px)];
+	  if( ids ) {
+	    ColorVec4 id = MeshObj::i_to_color(r.id);
+	    for( int k = 0; k < 4; k++ ) p[k] = id(k);
+	    continue;
+	  }
+	  // colors are interpolated in perspective, as OpenGL does
+	  Vec3f sum(0, 0, 0);
+	  float weight = 0;
+	  for( int k = 0; k < 3; k++ ) {
+	    float q = l[k] * r.w[v[k]];
+	    sum += r.color[v[k]] * q;
+	    weight += q;
+	  }
+	  sum /= weight;
+	  p[0] = to_byte(sum.x());  p[1] = to_byte(sum.y());  p[2] = to_byte(sum.z());
+	  p[3] = 255;
+	}
+    }
+}
+
+int Rasterizer::width(void) const  { return _width; }
+int Rasterizer::height(void) const { return _height; }
+const std::vector<GLubyte>& Rasterizer::pixels(void) const { return _pixels; }
+
+uint32_t Rasterizer::id_at(int x, int y) const {
+  return MeshObj::color_to_i(ColorVec4(&_pixels[4 * (y * _width + x)]));
+}
+
+void Rasterizer::write_ppm(const char* filename) const {
+  std::ofstream ofs(filename, std::ios::binary);
+  if( !ofs ) throw "Rasterizer::write_ppm(const char*): cannot open file.";
+  ofs << "P6\n" << _width << " " << _height << "\n255\n";
+  for( int y = _height - 1; y >= 0; y-- )
+    for( int x = 0; x < _width; x++ )
+      ofs.write((const char*)&_pixels[4 * (y * _width + x)], 3);
+}
+
+void Rasterizer::write_pam(const char* filename) const {
+  std::ofstream ofs(filename, std::ios::binary);
+  if( !ofs ) throw "Rasterizer::write_pam(const char*): cannot open file.";
+  ofs << "P7\nWIDTH " << _width << "\nHEIGHT " << _height
+      << "\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n";
+  for( int y = _height - 1; y >= 0; y-- )
+    ofs.write((const char*)&_pixels[4 * y * _width], 4 * _width);
+}
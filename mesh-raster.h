@@ -0,0 +1,67 @@
+#ifndef __MESH_RASTER_H__
+#define __MESH_RASTER_H__
+
+#include <vector>
+#include "mesh.h"
+
+//-----------------------------------------------------------------------------
+
+/* A tile-based CPU rasterizer which draws a MeshObj the way
+ * Draw::draw_scene() and Draw::draw_selectable() do, without a window or
+ * an OpenGL context. Tiles are filled in parallel; pixels are RGBA with
+ * the bottom row first, as glReadPixels() returns them.
+ */
+class Rasterizer {
+ public:
+  /* gluLookAt(position, origin, y up) and gluPerspective(fov, width /
+   * height, znear, zfar), with the mesh turned by rotation
+   */
+  struct Camera {
+    Camera();             // the viewer's start: from (5,5,5), 40 degrees
+    Vec3f position;
+    HMatrix<float> rotation;
+    float fov, znear, zfar;
+  };
+
+  Rasterizer(int width, int height);
+
+  /* the faces in color, lit by the viewer's two lights along z */
+  void draw_scene(MeshObj& mesh, const Camera& camera, const Vec3f& color,
+		  bool vertex_normals = false);
+  /* each face in its MeshObj::i_to_color() id, 0 where there is none */
+  void draw_selectable(MeshObj& mesh, const Camera& camera);
+
+  int width(void) const;
+  int height(void) const;
+  const std::vector<GLubyte>& pixels(void) const;
+  /* the face id at a pixel (y from the bottom, as in Input::MouseClick) */
+  uint32_t id_at(int x, int y) const;
+
+  /* binary PPM (RGB) and PAM (RGBA, keeps the ids' alpha byte) images */
+  void write_ppm(const char* filename) const;
+  void write_pam(const char* filename) const;
+
+ private:
+  struct Corner {
+    Vec4f clip;           // clip space position
+    Vec3f color;
+  };
+  struct Triangle {
+    float x[3], y[3], z[3], w[3];   // window position, depth and 1/w
+    Vec3f color[3];
+    uint32_t id;
+  };
+
+  void _draw(MeshObj& mesh, const Camera& camera, const Vec3f& color,
+	     bool vertex_normals, bool ids);
+  void _setup(const Corner* c, uint32_t id, std::vector<Triangle>& out) const;
+  void _fill(int tile, const std::vector< std::vector<Triangle> >& tris,
+	     const std::vector< std::vector< std::vector<int> > >& bins,
+	     bool ids);
+
+  int _width, _height;
+  std::vector<GLubyte> _pixels;
+  std::vector<float> _depth;
+};
+
+#endif
@@ -0,0 +1,286 @@
+#include <cstdlib>
+#include "mesh.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Isotropic remeshing (Botsch & Kobbelt): split long edges, collapse short
+// ones, flip towards regular valences and relax in the tangent planes
+
+namespace {
+
+  float length(const Edge* e) {
+    return (e->vert()->loc() - e->opp()->vert()->loc()).l2();
+  }
+
+  bool on_boundary(const Vert* v) { return v->edge()->face() == NULL; }
+
+  int target_valence(const Vert* v) { return on_boundary(v) ? 4 : 6; }
+
+  // is any of u, v and their neighbours locked?
+  bool ring_locked(const Edge* h, const std::vector<char>& locked) {
+    for( int i = 0; i < 2; i++, h = h->opp() ) {
+      VertVertRange ring = h->vert()->neighbours();
+      for( VertVertRange::iterator w = ring.begin(); w != ring.end(); ++w )
+	if( locked[w->index()] ) return true;
+    }
+    return false;
+  }
+
+  // locks u, v and their neighbours
+  void lock_ring(const Edge* h, std::vector<char>& locked) {
+    for( int i = 0; i < 2; i++, h = h->opp() ) {
+      VertVertRange ring = h->vert()->neighbours();
+      for( VertVertRange::iterator w = ring.begin(); w != ring.end(); ++w )
+	locked[w->index()] = 1;
+    }
+  }
+};
+
+void MeshObj::remesh(float target_length, int iterations) {
+  for( FaceItr i = _faces.begin(); i != _faces.end(); i++ )
+    if( (*i)->edge_count() != 3 )
+      throw "MeshObj::remesh(float, int): expects an all-triangle mesh.";
+
+  JournalScope edit(this, true);
+  _reorder_after_edit();
+  for( int i = 0; i < iterations; i++ ) {
+    _split_long_edges(target_length * 4 / 3);
+    _collapse_short_edges(target_length * 4 / 5, target_length * 4 / 3);
+    _equalize_valences();
+    _relax_tangentially();
+  }
+
+  std::vector<Face*> faces(_faces.begin(), _faces.end());
+  std::vector<Vert*> verts(_verts.begin(), _verts.end());
+#pragma omp parallel for
+  for( int i = 0; i < (int)faces.size(); i++ )
+    faces[i]->normal() = faces[i]->calculate_normal();
+#pragma omp parallel for
+  for( int i = 0; i < (int)verts.size(); i++ )
+    verts[i]->normal() = verts[i]->calculate_normal();
+}
+
+float MeshObj::mean_edge_length(void) const {
+  std::vector<Edge*> edges(_edges.begin(), _edges.end());
+  double sum = 0;
+#pragma omp parallel for reduction(+:sum)
+  for( int i = 0; i < (int)edges.size(); i++ )
+    sum += length(edges[i]);
+  return edges.empty() ? 0 : sum / edges.size();
+}
+
+void MeshObj::_split_long_edges(float max_length) {
+  std::list<Edge*> unused;
+  while( true ) {
+    index_elements();
+    std::vector<Edge*> edges(_edges.begin(), _edges.end());
+    int ne = edges.size();
+    std::vector<char> is_long(ne, 0);
+#pragma omp parallel for
+    for( int i = 0; i < ne; i++ )
+      is_long[i] = edges[i] < edges[i]->opp() && length(edges[i]) > max_length;
+
+    // one split per face, so every split face is bisected into two triangles
+    std::vector<char> used(_faces.size(), 0);
+    std::vector<Edge*> batch;
+    for( int i = 0; i < ne; i++ ) {
+      if( !is_long[i] ) continue;
+      Face* f = edges[i]->face();
+      Face* g = edges[i]->opp()->face();
+      if( (f != NULL && used[f->index()]) || (g != NULL && used[g->index()]) )
+	continue;
+      if( f != NULL ) used[f->index()] = 1;
+      if( g != NULL ) used[g->index()] = 1;
+      batch.push_back(edges[i]);
+    }
+    if( batch.empty() ) return;
+
+    std::vector<Vert*> verts;
+    split_edges(batch, verts);
+    for( int i = 0; i < (int)verts.size(); i++ ) {
+      Vert* v = verts[i];
+      bisect_subdiv_triangle(v, v->edge()->opp()->next(), unused);
+      if( v->edge()->face() != NULL )
+	bisect_subdiv_triangle(v, v->edge(), unused);
+    }
+  }
+}
+
+void MeshObj::_collapse_short_edges(float min_length, float max_length) {
+  while( true ) {
+    index_elements();
+    std::vector<Edge*> edges(_edges.begin(), _edges.end());
+    int ne = edges.size();
+
+    // short edges, directed to remove an interior vertex
+    std::vector<Edge*> cand(ne, (Edge*)NULL);
+#pragma omp parallel for
+    for( int i = 0; i < ne; i++ ) {
+      Edge* e = edges[i];
+      if( e > e->opp() || length(e) >= min_length ) continue;
+      if( !on_boundary(e->opp()->vert()) ) cand[i] = e;
+      else if( !on_boundary(e->vert()) ) cand[i] = e->opp();
+    }
+
+    // collapses whose 1-rings are disjoint do not touch the same elements
+    std::vector<char> locked(_verts.size(), 0);
+    std::vector<Edge*> batch;
+    for( int i = 0; i < ne; i++ )
+      if( cand[i] != NULL && !ring_locked(cand[i], locked) ) {
+	lock_ring(cand[i], locked);
+	batch.push_back(cand[i]);
+      }
+    if( batch.empty() ) return;
+
+    std::vector<Edge*> dead_edges;
+    std::vector<Face*> dead_faces;
+    std::vector<Vert*> dead_verts;
+#pragma omp parallel
+    {
+      std::vector<Edge*> de;
+      std::vector<Face*> df;
+      std::vector<Vert*> dv;
+#pragma omp for
+      for( int i = 0; i < (int)batch.size(); i++ ) {
+	Edge* h = batch[i];
+	if( !_collapse_ok(h) || _collapse_flips(h) ) continue;
+
+	// the edges which move to v must not get too long
+	const Vec3f& pv = h->vert()->loc();
+	VertVertRange ring = h->opp()->vert()->neighbours();
+	bool too_long = false;
+	for( VertVertRange::iterator w = ring.begin(); w != ring.end(); ++w )
+	  too_long = too_long || (w->loc() - pv).l2() > max_length;
+	if( too_long ) continue;
+
+	dv.push_back(_collapse(h, de, df));
+      }
+#pragma omp critical
+      {
+	dead_edges.insert(dead_edges.end(), de.begin(), de.end());
+	dead_faces.insert(dead_faces.end(), df.begin(), df.end());
+	dead_verts.insert(dead_verts.end(), dv.begin(), dv.end());
+      }
+    }
+    if( dead_verts.empty() ) return;
+    _purge(dead_edges, dead_faces, dead_verts);
+  }
+}
+
+void MeshObj::_equalize_valences(void) {
+  // a few rounds; flips of a round share no vertex, so the valences they
+  // were chosen by stay valid until the round is done
+  for( int round = 0; round < 10; round++ ) {
+    index_elements();
+    std::vector<Vert*> verts(_verts.begin(), _verts.end());
+    std::vector<Edge*> edges(_edges.begin(), _edges.end());
+    int nv = verts.size();
+    int ne = edges.size();
+
+    std::vector<int> valence(nv);
+#pragma omp parallel for
+    for( int i = 0; i < nv; i++ )
+      valence[i] = verts[i]->count_adjacent();
+
+    std::vector<char> improves(ne, 0);
+#pragma omp parallel for
+    for( int i = 0; i < ne; i++ ) {
+      Edge* e = edges[i];
+      Edge* o = e->opp();
+      if( e > o || e->face() == NULL || o->face() == NULL ) continue;
+      Vert* v[4] = { e->vert(), o->vert(), e->next()->vert(), o->next()->vert() };
+      int before = 0, after = 0;
+      for( int j = 0; j < 4; j++ ) {
+	int val = valence[v[j]->index()];
+	int target = target_valence(v[j]);
+	int flipped = val + (j < 2 ? -1 : 1);
+	before += abs(val - target);
+	after += abs(flipped - target);
+      }
+      improves[i] = after < before;
+    }
+
+    std::vector<char> locked(nv, 0);
+    std::vector<Edge*> batch;
+    for( int i = 0; i < ne; i++ ) {
+      if( !improves[i] ) continue;
+      Edge* e = edges[i];
+      Vert* v[4] = { e->vert(), e->opp()->vert(),
+		     e->next()->vert(), e->opp()->next()->vert() };
+      if( locked[v[0]->index()] || locked[v[1]->index()] ||
+	  locked[v[2]->index()] || locked[v[3]->index()] )
+	continue;
+      for( int j = 0; j < 4; j++ ) locked[v[j]->index()] = 1;
+      batch.push_back(e);
+    }
+    if( batch.empty() || flip_edges(batch) == 0 ) return;
+  }
+}
+
+void MeshObj::smooth(int iterations, float lambda) {
+  JournalScope edit(this, true);
+  std::vector<Face*> faces(_faces.begin(), _faces.end());
+  std::vector<Vert*> verts(_verts.begin(), _verts.end());
+  int nv = verts.size();
+
+  std::vector<Vec3f> pos(nv);
+  for( int it = 0; it < iterations; it++ ) {
+#pragma omp parallel for
+    for( int i = 0; i < nv; i++ ) {
+      Vert* v = verts[i];
+      pos[i] = v->loc();
+      if( v->edge() == NULL || on_boundary(v) ) continue;
+
+      Vec3f q(0, 0, 0);
+      int k = 0;
+      VertVertRange ring = v->neighbours();
+      for( VertVertRange::iterator w = ring.begin(); w != ring.end(); ++w, k++ )
+	q += w->loc();
+      pos[i] += (q / (float)k - pos[i]) * lambda;
+    }
+#pragma omp parallel for
+    for( int i = 0; i < nv; i++ )
+      verts[i]->loc() = pos[i];
+  }
+
+#pragma omp parallel for
+  for( int i = 0; i < (int)faces.size(); i++ )
+    faces[i]->normal() = faces[i]->calculate_normal();
+#pragma omp parallel for
+  for( int i = 0; i < nv; i++ )
+    verts[i]->normal() = verts[i]->calculate_normal();
+}
+
+void MeshObj::_relax_tangentially(void) {
+  std::vector<Face*> faces(_faces.begin(), _faces.end());
+  std::vector<Vert*> verts(_verts.begin(), _verts.end());
+  int nv = verts.size();
+#pragma omp parallel for
+  for( int i = 0; i < (int)faces.size(); i++ )
+    faces[i]->normal() = faces[i]->calculate_normal();
+
+  // move each interior vertex towards the centroid of its neighbours,
+  // but only within its tangent plane
+  std::vector<Vec3f> pos(nv);
+#pragma omp parallel for
+  for( int i = 0; i < nv; i++ ) {
+    Vert* v = verts[i];
+    pos[i] = v->loc();
+    if( v->edge() == NULL || on_boundary(v) ) continue;
+
+    Vec3f q(0, 0, 0);
+    int k = 0;
+    VertVertRange ring = v->neighbours();
+    for( VertVertRange::iterator w = ring.begin(); w != ring.end(); ++w, k++ )
+      q += w->loc();
+    q /= (float)k;
+
+    Vec3f n = v->calculate_normal();
+    float len = n.l2();
+    if( len > 0 ) n /= len;
+    pos[i] = q + n * n.dot(v->loc() - q);
+  }
+
+#pragma omp parallel for
+  for( int i = 0; i < nv; i++ )
+    verts[i]->loc() = pos[i];
+}
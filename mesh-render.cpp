@@ -0,0 +1,57 @@
+#include <cstring>
+#include <unordered_map>
+#include "mesh.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Corner attributes out of the mesh: indexed OBJ texture coordinates and
+// normals
+
+namespace {
+
+  // hashes and compares values by their bytes (floats are matched exactly)
+  template <class T> struct BitwiseHash {
+    size_t operator()(const T& v) const {
+      const unsigned char* p = (const unsigned char*)&v;
+      size_t h = 2166136261u;                   // FNV-1a
+      for( size_t i = 0; i < sizeof(T); i++ ) h = (h ^ p[i]) * 16777619u;
+      return h;
+    }
+  };
+
+  template <class T> struct BitwiseEqual {
+    bool operator()(const T& a, const T& b) const {
+      return memcmp(&a, &b, sizeof(T)) == 0;
+    }
+  };
+
+  template <class T> struct ValueIndex {
+    typedef std::unordered_map<T, int, BitwiseHash<T>, BitwiseEqual<T> > Map;
+  };
+
+  // the index of v in values, appending it if it is new
+  template <class T>
+  int index_of(const T& v, typename ValueIndex<T>::Map& index,
+	       std::vector<T>& values) {
+    std::pair<typename ValueIndex<T>::Map::iterator, bool> i =
+      index.insert(std::make_pair(v, (int)values.size()));
+    if( i.second ) values.push_back(v);
+    return i.first->second;
+  }
+};
+
+void MeshObj::_export_corners(MeshLoad::OBJMesh& m) {
+  Property<Vec2f>* uv = _eprops.get<Vec2f>("uv");
+  Property<Vec3f>* nor = _eprops.get<Vec3f>("nor");
+  if( uv == NULL && nor == NULL ) return;
+
+  ValueIndex<Vec2f>::Map uvs;
+  ValueIndex<Vec3f>::Map nors;
+  int k = 0;
+  for( FaceItr i = _faces.begin(); i != _faces.end(); i++ ) {
+    FaceEdgeRange r = (*i)->edges();
+    for( FaceEdgeRange::iterator e = r.begin(); e != r.end(); ++e, k++ ) {
+      if( uv != NULL ) m.faces[k].uvIdx = index_of((*uv)[*e], uvs, m.uv);
+      if( nor != NULL ) m.faces[k].norIdx = index_of((*nor)[*e], nors, m.nor);
+    }
+  }
+}
@@ -0,0 +1,106 @@
+#include <algorithm>
+#include "mesh.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Reordering along a Morton (Z-order) curve: the bounding box is cut into
+// 2^21 cells per axis and elements are sorted by their cell's interleaved
+// coordinate bits
+
+namespace {
+
+  const int MORTON_BITS = 21;
+
+  // spreads the low 21 bits of x to every third bit
+  uint64_t spread(uint64_t x) {
+    x &= 0x1fffff;
+    x = (x | x << 32) & 0x1f00000000ffffULL;
+    x = (x | x << 16) & 0x1f0000ff0000ffULL;
+    x = (x | x << 8)  & 0x100f00f00f00f00fULL;
+    x = (x | x << 4)  & 0x10c30c30c30c30c3ULL;
+    x = (x | x << 2)  & 0x1249249249249249ULL;
+    return x;
+  }
+
+  struct Curve {
+    Vec3f lo, scale;
+
+    uint64_t code(const Vec3f& p) const {
+      uint64_t c[3];
+      for( int k = 0; k < 3; k++ ) {
+	float t = (p[k] - lo[k]) * scale[k];
+	c[k] = (uint64_t)std::max(0.0f, std::min(t, (float)((1 << MORTON_BITS) - 1)));
+      }
+      return spread(c[0]) | spread(c[1]) << 1 | spread(c[2]) << 2;
+    }
+  };
+
+  typedef std::pair<uint64_t, int> Code;
+
+  // the elements in the order of their codes (ties keep the old order)
+  template <class T>
+  void sort_by(const std::vector<Code>& codes, const std::vector<T*>& in,
+	       std::vector<T*>& out) {
+    std::vector<Code> c(codes);
+    std::sort(c.begin(), c.end());
+    out.resize(in.size());
+    for( int i = 0; i < (int)c.size(); i++ ) out[i] = in[c[i].second];
+  }
+};
+
+void MeshObj::reorder(void) {
+  std::vector<Vert*> verts(_verts.begin(), _verts.end());
+  std::vector<Face*> faces(_faces.begin(), _faces.end());
+  int nv = verts.size(), nf = faces.size();
+  if( nv == 0 ) return;
+
+  Curve curve;
+  Vec3f hi = verts[0]->loc();
+  curve.lo = hi;
+  for( int i = 1; i < nv; i++ ) {
+    curve.lo = curve.lo.min(verts[i]->loc());
+    hi = hi.max(verts[i]->loc());
+  }
+  for( int k = 0; k < 3; k++ )
+    curve.scale(k) = (hi[k] > curve.lo[k]) ?
+      ((1 << MORTON_BITS) - 1) / (hi[k] - curve.lo[k]) : 0;
+
+  std::vector<Code> vcodes(nv), fcodes(nf);
+#pragma omp parallel for
+  for( int i = 0; i < nv; i++ ) vcodes[i] = Code(curve.code(verts[i]->loc()), i);
+#pragma omp parallel for
+  for( int i = 0; i < nf; i++ ) fcodes[i] = Code(curve.code(faces[i]->centroid()), i);
+
+  std::vector<Vert*> vorder;
+  std::vector<Face*> forder;
+  sort_by(vcodes, verts, vorder);
+  sort_by(fcodes, faces, forder);
+
+  // half-edges face by face, then the boundary ones by their vertex
+  std::vector<Edge*> eorder;
+  eorder.reserve(_edges.size());
+  for( int i = 0; i < nf; i++ ) {
+    FaceEdgeRange r = forder[i]->edges();
+    for( FaceEdgeRange::iterator e = r.begin(); e != r.end(); ++e )
+      eorder.push_back(*e);
+  }
+  for( int i = 0; i < nv; i++ ) vorder[i]->index() = i;
+  std::vector<Code> bcodes;
+  std::vector<Edge*> boundary;
+  for( EdgeItr i = _edges.begin(); i != _edges.end(); i++ )
+    if( (*i)->face() == NULL ) {
+      bcodes.push_back(Code((*i)->vert()->index(), boundary.size()));
+      boundary.push_back(*i);
+    }
+  std::vector<Edge*> border;
+  sort_by(bcodes, boundary, border);
+  eorder.insert(eorder.end(), border.begin(), border.end());
+
+  MeshObj m;
+  m._copy(*this, vorder, eorder, forder);
+  replace(m);
+}
+
+void MeshObj::set_auto_reorder(bool on) { _auto_reorder = on; }
+bool MeshObj::auto_reorder(void) const  { return _auto_reorder; }
+
+void MeshObj::_reorder_after_edit(void) { _reorder_pending = true; }
@@ -0,0 +1,395 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <unordered_map>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "mesh-stream.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Streaming: one pass over the text writes the positions and the faces to
+// binary temporary files, one over the faces puts the slab borders at
+// quantiles of the face centroids, one deals the faces (and their ghost
+// copies) out to a file per slab, and then the slabs are processed in order
+
+namespace {
+
+  typedef long long Id;
+  const int BINS = 1 << 16;          // of the centroid histogram
+
+  // an already unlinked read-write file in dir
+  FILE* temp_file(const char* dir) {
+    std::string path = std::string(dir) + "/meshstreamXXXXXX";
+    std::vector<char> name(path.begin(), path.end());
+    name.push_back(0);
+    int fd = mkstemp(&name[0]);
+    if( fd < 0 ) throw "MeshStream::process(): cannot create a temporary file.";
+    unlink(&name[0]);
+    FILE* f = fdopen(fd, "w+b");
+    if( f == NULL ) {
+      close(fd);
+      throw "MeshStream::process(): cannot open a temporary file.";
+    }
+    return f;
+  }
+
+  void put(FILE* f, const void* p, size_t bytes) {
+    if( bytes > 0 && fwrite(p, bytes, 1, f) != 1 )
+      throw "MeshStream::process(): cannot write a temporary file.";
+  }
+
+  bool get(FILE* f, void* p, size_t bytes) {
+    return bytes == 0 || fread(p, bytes, 1, f) == 1;
+  }
+
+  // a face record: its size, then its vertex ids
+  void put_face(FILE* f, const std::vector<Id>& ids) {
+    int n = ids.size();
+    put(f, &n, sizeof(n));
+    put(f, &ids[0], n * sizeof(Id));
+  }
+
+  bool get_face(FILE* f, std::vector<Id>& ids) {
+    int n;
+    if( !get(f, &n, sizeof(n)) ) return false;
+    ids.resize(n);
+    if( !get(f, &ids[0], n * sizeof(Id)) )
+      throw "MeshStream::process(): truncated temporary file.";
+    return true;
+  }
+
+  /* the v and f lines of the OBJ file, as positions (3 floats each) and
+   * face records; returns the number of vertices
+   */
+  Id split_input(const char* in, FILE* pos, FILE* faces, Vec3f& lo, Vec3f& hi,
+		 long& nf) {
+    std::ifstream ifs(in);
+    if( !ifs ) throw "MeshStream::process(): cannot open the input.";
+    std::string line;
+    std::vector<Id> ids;
+    Id nv = 0;
+    nf = 0;
+    while( std::getline(ifs, line) ) {
+      const char* s = line.c_str();
+      while( *s == ' ' || *s == '\t' ) s++;
+      if( s[0] == 'v' && (s[1] == ' ' || s[1] == '\t') ) {
+	char* end;
+	float p[3];
+	p[0] = strtof(s + 1, &end);
+	p[1] = strtof(end, &end);
+	p[2] = strtof(end, &end);
+	put(pos, p, sizeof(p));
+	Vec3f v(p);
+	lo = nv ? lo.min(v) : v;
+	hi = nv ? hi.max(v) : v;
+	nv++;
+      }
+      else if( s[0] == 'f' && (s[1] == ' ' || s[1] == '\t') ) {
+	ids.clear();
+	const char* t = s + 1;
+	while( true ) {
+	  char* end;
+	  Id i = strtoll(t, &end, 10);
+	  if( end == t ) break;
+	  ids.push_back(i < 0 ? nv + i : i - 1);
+	  // past the texture coordinate and normal indices
+	  for( t = end; *t != 0 && *t != ' ' && *t != '\t'; t++ );
+	}
+	if( ids.size() >= 3 ) {
+	  put_face(faces, ids);
+	  nf++;
+	}
+      }
+    }
+    return nv;
+  }
+
+  // a slab: faces of corners (local vertex numbers), owned or ghosts
+  struct Slab {
+    std::vector<char> owned;
+    std::vector<int> start;          // one past the last face too
+    std::vector<int> corners;
+    std::vector<Id> ids;             // input vertex of each local one
+  };
+
+  /* Drops the ghost faces around pinched vertices (MeshObj::find_pinches),
+   * until the slab can be built as a manifold MeshObj.
+   */
+  void remove_pinches(Slab& s) {
+    while( true ) {
+      int nf = s.owned.size(), nv = s.ids.size();
+      std::vector<char> pinched;
+      if( !MeshObj::find_pinches(s.corners, s.start, nv, pinched) ) return;
+
+      Slab rest;
+      rest.start.push_back(0);
+      for( int f = 0; f < nf; f++ ) {
+	bool pinch = false;
+	for( int j = s.start[f]; j < s.start[f + 1]; j++ )
+	  pinch = pinch || pinched[s.corners[j]];
+	if( pinch && !s.owned[f] ) continue;
+	rest.owned.push_back(s.owned[f]);
+	rest.corners.insert(rest.corners.end(), s.corners.begin() + s.start[f],
+			    s.corners.begin() + s.start[f + 1]);
+	rest.start.push_back(rest.corners.size());
+      }
+      if( rest.owned.size() == s.owned.size() )
+	throw "MeshStream::process(): the input is not manifold.";
+
+      // renumber the vertices which are left
+      std::vector<int> local(nv, -1);
+      for( int j = 0; j < (int)rest.corners.size(); j++ ) {
+	int& l = local[rest.corners[j]];
+	if( l < 0 ) {
+	  l = rest.ids.size();
+	  rest.ids.push_back(s.ids[rest.corners[j]]);
+	}
+	rest.corners[j] = l;
+      }
+      std::swap(s, rest);
+    }
+  }
+
+  /* Output vertices near a slab border by position: a cell grid the size
+   * of the tolerance, searched in the 27 cells around a point.
+   */
+  class BorderMap {
+   public:
+    BorderMap(float tolerance) : _tolerance(tolerance) {  }
+
+    void insert(const Vec3f& p, Id id) {
+      _cells[_key(_cell(p, 0), _cell(p, 1), _cell(p, 2))].push_back(Entry(p, id));
+    }
+
+    // the id of a vertex within the tolerance of p, or -1
+    Id find(const Vec3f& p) const {
+      for( int dx = -1; dx <= 1; dx++ )
+	for( int dy = -1; dy <= 1; dy++ )
+	  for( int dz = -1; dz <= 1; dz++ ) {
+	    Cells::const_iterator c = _cells.find(_key(_cell(p, 0) + dx,
+						       _cell(p, 1) + dy,
+						       _cell(p, 2) + dz));
+	    if( c == _cells.end() ) continue;
+	    for( int i = 0; i < (int)c->second.size(); i++ )
+	      if( (c->second[i].first - p).l2() <= _tolerance )
+		return c->second[i].second;
+	  }
+      return -1;
+    }
+
+    void clear(void) { _cells.clear(); }
+
+   private:
+    typedef std::pair<Vec3f, Id> Entry;
+    typedef std::unordered_map<uint64_t, std::vector<Entry> > Cells;
+
+    Id _cell(const Vec3f& p, int k) const { return (Id)floor(p(k) / _tolerance); }
+    uint64_t _key(Id x, Id y, Id z) const {
+      return (uint64_t)x * 73856093u ^ (uint64_t)y * 19349663u ^ (uint64_t)z * 83492791u;
+    }
+
+    float _tolerance;
+    Cells _cells;
+  };
+
+  Vec3f vertex(const float* pos, Id i) { return Vec3f(pos + 3 * i); }
+
+  void to_obj(const Slab& s, const float* pos, MeshLoad::OBJMesh& obj) {
+    obj.pos.reserve(s.ids.size());
+    for( int i = 0; i < (int)s.ids.size(); i++ )
+      obj.pos.push_back(vertex(pos, s.ids[i]));
+    obj.face_startidx.assign(s.start.begin(), s.start.end() - 1);
+    obj.faces.reserve(s.corners.size());
+    for( int j = 0; j < (int)s.corners.size(); j++ )
+      obj.faces.push_back(MeshLoad::VTXindex(s.corners[j], -1, -1));
+  }
+};
+
+MeshStream::Options::Options()
+  : max_faces(1 << 20), rings(2), normals(false), tolerance(0), temp_dir("/tmp")
+{  }
+
+long MeshStream::process(const char* in, const char* out,
+			 const std::vector<Operation>& ops,
+			 const Options& options) {
+  if( options.max_faces < 1 )
+    throw "MeshStream::process(): max_faces must be at least 1.";
+  FILE* pos_file = temp_file(options.temp_dir);
+  FILE* face_file = temp_file(options.temp_dir);
+  Vec3f lo(0, 0, 0), hi(0, 0, 0);
+  long nf;
+  Id nv = split_input(in, pos_file, face_file, lo, hi, nf);
+  fflush(pos_file);
+  if( nv == 0 || nf == 0 ) {
+    fclose(pos_file);
+    fclose(face_file);
+    throw "MeshStream::process(): the input has no faces.";
+  }
+  const float* pos = (const float*)mmap(NULL, nv * 3 * sizeof(float), PROT_READ,
+					MAP_SHARED, fileno(pos_file), 0);
+  if( pos == MAP_FAILED ) throw "MeshStream::process(): cannot map the positions.";
+
+  // the borders go across the longest axis
+  Vec3f ext = hi - lo;
+  int axis = (ext.x() > ext.y()) ? (ext.x() > ext.z() ? 0 : 2)
+                                 : (ext.y() > ext.z() ? 1 : 2);
+  float width = std::max(ext(axis), FLT_MIN);
+
+  std::vector<long> histogram(BINS, 0);
+  float min_edge = FLT_MAX, max_edge = 0;
+  std::vector<Id> ids;
+  rewind(face_file);
+  while( get_face(face_file, ids) ) {
+    float c = 0;
+    for( int j = 0; j < (int)ids.size(); j++ ) {
+      if( ids[j] < 0 || ids[j] >= nv )
+	throw "MeshStream::process(): a face index is out of range.";
+      c += pos[3 * ids[j] + axis];
+    }
+    c /= ids.size();
+    histogram[std::min(BINS - 1, (int)((c - lo(axis)) / width * BINS))]++;
+    for( int j = 0; j < (int)ids.size(); j++ ) {
+      float l = (vertex(pos, ids[j]) - vertex(pos, ids[(j + 1) % ids.size()])).l2();
+      if( l > 0 ) min_edge = std::min(min_edge, l);
+      max_edge = std::max(max_edge, l);
+    }
+  }
+  float margin = (options.rings + 1) * max_edge;
+  float tolerance = options.tolerance;
+  if( tolerance <= 0 )
+    tolerance = (min_edge < FLT_MAX) ? min_edge / 1000 : ext.l2() * 1e-6f;
+  tolerance = std::max(tolerance, FLT_MIN);
+
+  // cuts after every max_faces centroids, at least two margins apart so
+  // that only neighbouring slabs share vertices
+  long slabs = std::max(1L, (long)((nf + options.max_faces - 1) / options.max_faces));
+  std::vector<float> cuts;
+  long sum = 0, per = nf / slabs, next = per;
+  for( int b = 0; b < BINS && next < nf; b++ ) {
+    sum += histogram[b];
+    float cut = lo(axis) + (b + 1) * width / BINS;
+    float last = cuts.empty() ? lo(axis) : cuts.back();
+    if( sum >= next && cut - last >= 2 * margin ) {
+      cuts.push_back(cut);
+      next = sum + per;
+    }
+  }
+  while( !cuts.empty() && hi(axis) - cuts.back() < 2 * margin ) cuts.pop_back();
+  int k = cuts.size() + 1;
+
+  // each face goes to the slab of its centroid, and as a ghost to the
+  // others within a margin of its vertices
+  std::vector<FILE*> slab_files(k);
+  for( int s = 0; s < k; s++ ) slab_files[s] = temp_file(options.temp_dir);
+  rewind(face_file);
+  while( get_face(face_file, ids) ) {
+    float c = 0, fmin = FLT_MAX, fmax = -FLT_MAX;
+    for( int j = 0; j < (int)ids.size(); j++ ) {
+      float x = pos[3 * ids[j] + axis];
+      c += x;
+      fmin = std::min(fmin, x);
+      fmax = std::max(fmax, x);
+    }
+    c /= ids.size();
+    int owner = std::upper_bound(cuts.begin(), cuts.end(), c) - cuts.begin();
+    int t0 = std::lower_bound(cuts.begin(), cuts.end(), fmin - margin) - cuts.begin();
+    int t1 = std::upper_bound(cuts.begin(), cuts.end(), fmax + margin) - cuts.begin();
+    for( int t = t0; t <= t1; t++ ) {
+      char owned = (t == owner);
+      put(slab_files[t], &owned, 1);
+      put_face(slab_files[t], ids);
+    }
+  }
+  fclose(face_file);
+
+  FILE* ofs = fopen(out, "w");
+  if( ofs == NULL ) throw "MeshStream::process(): cannot open the output.";
+  BorderMap below(tolerance), above(tolerance);
+  Id written = 0;
+  long faces_out = 0;
+  for( int s = 0; s < k; s++ ) {
+    Slab slab;
+    slab.start.push_back(0);
+    rewind(slab_files[s]);
+    char owned;
+    while( get(slab_files[s], &owned, 1) ) {
+      if( !get_face(slab_files[s], ids) )
+	throw "MeshStream::process(): truncated temporary file.";
+      slab.owned.push_back(owned);
+      slab.ids.insert(slab.ids.end(), ids.begin(), ids.end());
+      slab.start.push_back(slab.ids.size());
+    }
+    fclose(slab_files[s]);
+
+    // local vertex numbers
+    std::vector<Id> sorted(slab.ids);
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+    slab.corners.resize(slab.ids.size());
+    for( int j = 0; j < (int)slab.ids.size(); j++ )
+      slab.corners[j] = std::lower_bound(sorted.begin(), sorted.end(), slab.ids[j])
+	- sorted.begin();
+    slab.ids.swap(sorted);
+    remove_pinches(slab);
+    if( slab.owned.empty() ) continue;
+
+    MeshLoad::OBJMesh obj;
+    to_obj(slab, pos, obj);
+    MeshObj mesh(std::move(obj));
+    // split faces keep their parent's flag
+    Property<int>& own = mesh.add_face_property<int>("owned", 0);
+    for( int i = 0; i < (int)slab.owned.size(); i++ ) own[i] = slab.owned[i];
+    slab = Slab();
+
+    for( int i = 0; i < (int)ops.size(); i++ ) ops[i](mesh);
+
+    // vertices near the lower cut may have been written by the last slab,
+    // those near the upper one are kept for the next
+    mesh.index_elements();
+    std::vector<Id> out_id(mesh.verts().size(), -1);
+    float lower = (s > 0) ? cuts[s - 1] : -FLT_MAX;
+    float upper = (s < k - 1) ? cuts[s] : FLT_MAX;
+    for( list<Face*>::const_iterator f = mesh.faces().begin();
+	 f != mesh.faces().end(); f++ ) {
+      if( !own[*f] ) continue;
+      FaceVertRange r = (*f)->verts();
+      for( FaceVertRange::iterator v = r.begin(); v != r.end(); ++v ) {
+	Id& id = out_id[v->index()];
+	if( id >= 0 ) continue;
+	const Vec3f& p = v->loc();
+	if( p(axis) <= lower + margin ) id = below.find(p);
+	if( id < 0 ) {
+	  id = written++;
+	  fprintf(ofs, "v %.9g %.9g %.9g\n", p.x(), p.y(), p.z());
+	  if( options.normals ) {
+	    Vec3f n = v->calculate_normal();
+	    float len = n.l2();
+	    if( len > 0 ) n /= len;
+	    fprintf(ofs, "vn %.6g %.6g %.6g\n", n.x(), n.y(), n.z());
+	  }
+	}
+	if( p(axis) >= upper - margin ) above.insert(p, id);
+      }
+    }
+    for( list<Face*>::const_iterator f = mesh.faces().begin();
+	 f != mesh.faces().end(); f++ ) {
+      if( !own[*f] ) continue;
+      fprintf(ofs, "f");
+      FaceVertRange r = (*f)->verts();
+      for( FaceVertRange::iterator v = r.begin(); v != r.end(); ++v ) {
+	Id id = out_id[v->index()] + 1;
+	if( options.normals ) fprintf(ofs, " %lld//%lld", id, id);
+	else fprintf(ofs, " %lld", id);
+      }
+      fprintf(ofs, "\n");
+      faces_out++;
+    }
+    std::swap(below, above);
+    above.clear();
+  }
+
+  fclose(ofs);
+  munmap((void*)pos, nv * 3 * sizeof(float));
+  fclose(pos_file);
+  return faces_out;
+}
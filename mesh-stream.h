@@ -0,0 +1,43 @@
+#ifndef __MESH_STREAM_H__
+#define __MESH_STREAM_H__
+
+#include <vector>
+#include "mesh.h"
+
+//-----------------------------------------------------------------------------
+
+/* Out-of-core processing of OBJ files too large for memory. The faces are
+ * cut into slabs along the longest axis, each holding about max_faces of
+ * them. One slab at a time is built as a MeshObj together with a ghost
+ * margin of the faces around it, edited, and its own faces are written
+ * out; vertices on a border between two slabs are written once (matched
+ * by position). Only the vertex positions, in a memory mapped temporary
+ * file, and one slab are held. Texture coordinates and normals of the
+ * input are not kept.
+ */
+namespace MeshStream {
+  // edits a slab in place; may throw const char* like the MeshObj edits
+  typedef void (*Operation)(MeshObj&);
+
+  struct Options {
+    Options();
+    unsigned int max_faces;     // faces per slab, about
+    /* how many rings of faces (as long as the longest input edge) the
+     * operations read around a face; sets the ghost margin
+     */
+    int rings;
+    bool normals;               // write vertex normals
+    float tolerance;            // border matching, 0: a thousandth of the
+                                // shortest input edge
+    const char* temp_dir;       // for the temporary files
+  };
+
+  /* Runs ops in order on each slab of the OBJ file in and writes the
+   * result to out. Returns the number of faces written.
+   */
+  long process(const char* in, const char* out,
+	       const std::vector<Operation>& ops,
+	       const Options& options = Options());
+};
+
+#endif
@@ -0,0 +1,76 @@
+#include <cstdio>
+#include <omp.h>
+#include "mesh-worker.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// class MeshWorker
+
+MeshWorker::MeshWorker() : _done(false), _error(NULL), _base(0), _started(0)
+{  }
+
+MeshWorker::~MeshWorker() {
+  if( _thread.joinable() ) _thread.join();
+}
+
+void MeshWorker::submit(MeshObj& mesh, const char* name, Operation op) {
+  Job j = { name, op };
+  _queue.push_back(j);
+  if( _queue.size() == 1 ) _start(mesh);
+}
+
+bool MeshWorker::busy(void) const { return !_queue.empty(); }
+
+void MeshWorker::_start(MeshObj& mesh) {
+  _done = false;
+  _error = NULL;
+  _base = mesh.version();
+  _started = omp_get_wtime();
+  _thread = std::thread(&MeshWorker::_run, this, mesh.snapshot(),
+			_queue.front().op, mesh.auto_reorder());
+}
+
+void MeshWorker::_run(MeshSnapshot s, Operation op, bool reorder) {
+  try {
+    MeshObj m(s);
+    op(m);
+    if( reorder ) m.reorder();
+    _result = std::move(m);
+  }
+  catch( const char* err ) { _error = err; }
+  catch( ... ) { _error = "MeshWorker::_run(): operation failed."; }
+  _done = true;
+}
+
+bool MeshWorker::poll(MeshObj& mesh) {
+  if( _queue.empty() || !_done ) return false;
+  _thread.join();
+
+  if( _error != NULL ) {
+    _queue.clear();
+    _result.clear();
+    throw _error;
+  }
+
+  bool changed = mesh.version() == _base;
+  if( changed ) mesh.replace(_result);
+  else cout << "MeshWorker: mesh was edited during "
+	    << _queue.front().name << ", result dropped." << endl;
+  _result.clear();
+
+  _queue.pop_front();
+  if( !_queue.empty() ) _start(mesh);
+  return changed;
+}
+
+std::string MeshWorker::status(void) const {
+  if( _queue.empty() ) return "";
+  char buf[256];
+  snprintf(buf, sizeof(buf), "%s, %.1fs", _queue.front().name,
+	   omp_get_wtime() - _started);
+  std::string s(buf);
+  if( _queue.size() > 1 ) {
+    snprintf(buf, sizeof(buf), " (%d queued)", (int)_queue.size() - 1);
+    s += buf;
+  }
+  return s;
+}
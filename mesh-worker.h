@@ -0,0 +1,58 @@
+#ifndef __MESH_WORKER_H__
+#define __MESH_WORKER_H__
+
+#include <atomic>
+#include <deque>
+#include <string>
+#include <thread>
+#include "mesh.h"
+
+//-----------------------------------------------------------------------------
+
+/* Runs heavy edits off the GUI thread. Queued operations run one at a time
+ * on a worker thread, each on a MeshObj rebuilt from a snapshot of the mesh
+ * (so the mesh can still be drawn meanwhile), and poll() swaps the result
+ * into the mesh as one undoable edit. The mesh must not be edited while
+ * the worker is busy; a result whose mesh was edited anyway is dropped.
+ */
+class MeshWorker {
+ public:
+  // edits the mesh in place; may throw const char* like the MeshObj edits
+  typedef void (*Operation)(MeshObj&);
+
+  MeshWorker();
+  ~MeshWorker();   // waits for the running operation
+
+  /* queues op; it starts right away unless another one is running */
+  void submit(MeshObj& mesh, const char* name, Operation op);
+
+  /* Call from the GUI thread. Swaps a finished result into mesh and starts
+   * the next operation. Returns true if mesh changed. Rethrows the error
+   * of a failed operation (and drops the queue).
+   */
+  bool poll(MeshObj& mesh);
+
+  bool busy(void) const;
+  /* "name, 1.5s (2 queued)" for the running operation, "" when idle */
+  std::string status(void) const;
+
+ private:
+  struct Job {
+    const char* name;
+    Operation op;
+  };
+
+  void _start(MeshObj& mesh);
+  // on the worker thread; reorders the result if the mesh auto reorders
+  void _run(MeshSnapshot s, Operation op, bool reorder);
+
+  std::deque<Job> _queue;           // the first one is running
+  std::thread _thread;
+  std::atomic<bool> _done;          // _result or _error is ready
+  MeshObj _result;
+  const char* _error;
+  unsigned int _base;               // mesh version the running op started at
+  double _started;                  // omp_get_wtime() at start
+};
+
+#endif
@@ -1,24 +1,337 @@
+#include <unordered_map>
 #include "mesh.h"
 
+///////////////////////////////////////////////////////////////////////////////
+// class MeshSnapshot
+
+MeshSnapshot::MeshSnapshot() : _version(0)
+{  }
+
+bool MeshSnapshot::empty(void) const { return !_obj; }
+
+const MeshLoad::OBJMesh& MeshSnapshot::obj(void) const { return *_obj; }
+const std::vector<uint32_t>& MeshSnapshot::colors(void) const { return *_colors; }
+unsigned int MeshSnapshot::version(void) const { return _version; }
+
 ///////////////////////////////////////////////////////////////////////////////
 // class MeshObj
 
 void print_vert(const Vert& v) { cout << v.loc() << endl; }
 
-MeshObj::MeshObj()
+MeshObj::MeshObj() 
+  : _journaling(false), _journal_depth(0), _record(NULL), _edit_depth(0),
+    _auto_reorder(false), _reorder_pending(false), _version(0)
 {  }
 
-MeshObj::MeshObj(const MeshLoad::OBJMesh& m)
+MeshObj::MeshObj(const MeshLoad::OBJMesh& m) 
+  : _journaling(false), _journal_depth(0), _record(NULL), _edit_depth(0),
+    _auto_reorder(false), _reorder_pending(false), _version(0)
 {
   construct(m);
 }
 
-MeshObj::MeshObj(const char* filename) {
+MeshObj::MeshObj(MeshLoad::OBJMesh&& m) 
+  : _journaling(false), _journal_depth(0), _record(NULL), _edit_depth(0),
+    _auto_reorder(false), _reorder_pending(false), _version(0)
+{
+  construct(m, &m);
+}
+
+MeshObj::MeshObj(const char* filename) 
+  : _journaling(false), _journal_depth(0), _record(NULL), _edit_depth(0),
+    _auto_reorder(false), _reorder_pending(false), _version(0) {
   MeshLoad::OBJMesh *m = MeshLoad::readOBJ(filename);
-  construct(*m);
+  construct(*m, m);
   delete m;
 }
 
+MeshObj::MeshObj(const MeshSnapshot& s)
+  : _journaling(false), _journal_depth(0), _record(NULL), _edit_depth(0),
+    _auto_reorder(false), _reorder_pending(false), _version(0)
+{
+  if( s.empty() ) return;
+  construct(s.obj());
+
+  _color_to_face.clear();
+  _face_to_color.clear();
+  int n = 0;
+  for( FaceItr i = _faces.begin(); i != _faces.end(); i++, n++ ) {
+    _color_to_face[s.colors()[n]] = *i;
+    _face_to_color[*i] = s.colors()[n];
+  }
+  // construct() gave the i-th element slot i, and the boundary half-edges
+  // the slots after the corners
+  _vprops = *s._vprops;
+  _fprops = *s._fprops;
+  _eprops = *s._eprops;
+  _eprops.resize(_edges.size());
+}
+
+MeshObj::MeshObj(const MeshObj& m)
+  : _journaling(false), _journal_depth(0), _record(NULL), _edit_depth(0),
+    _auto_reorder(false), _reorder_pending(false), _version(0)
+{
+  _copy(m);
+}
+
+MeshObj::MeshObj(MeshObj&& m)
+  : _journaling(false), _journal_depth(0), _record(NULL), _edit_depth(0),
+    _auto_reorder(false), _reorder_pending(false), _version(0)
+{
+  _take(m);
+}
+
+MeshObj& MeshObj::operator=(const MeshObj& m) {
+  if( this != &m ) {
+    clear();
+    _copy(m);
+  }
+  return *this;
+}
+
+MeshObj& MeshObj::operator=(MeshObj&& m) {
+  if( this != &m ) {
+    clear();
+    _take(m);
+  }
+  return *this;
+}
+
+MeshObj::~MeshObj() { clear(); }
+
+void MeshObj::_copy(const MeshObj& m) {
+  std::vector<Vert*> sv(m._verts.begin(), m._verts.end());
+  std::vector<Edge*> se(m._edges.begin(), m._edges.end());
+  std::vector<Face*> sf(m._faces.begin(), m._faces.end());
+  _copy(m, sv, se, sf);
+}
+
+namespace {
+
+  // the position of each element in v by its slot, as slots are unique
+  template <class T>
+  void positions(const std::vector<T*>& v, const PropertySet& props,
+		 std::vector<int>& at) {
+    at.assign(props.slots(), -1);
+    for( int i = 0; i < (int)v.size(); i++ ) at[v[i]->slot()] = i;
+  }
+};
+
+void MeshObj::_copy(const MeshObj& m, const std::vector<Vert*>& sv,
+		    const std::vector<Edge*>& se, const std::vector<Face*>& sf) {
+  int nv = sv.size(), ne = se.size(), nf = sf.size();
+
+  // the copies are found through the slots of the originals, which are
+  // left as they are (m may be read by other threads)
+  std::vector<int> vi, ei, fi;
+  positions(sv, m._vprops, vi);
+  positions(se, m._eprops, ei);
+  positions(sf, m._fprops, fi);
+
+  std::vector<Vert*> verts(nv);
+  std::vector<Edge*> edges(ne);
+  std::vector<Face*> faces(nf);
+  for( int i = 0; i < nv; i++ ) verts[i] = new Vert();
+  for( int i = 0; i < ne; i++ ) edges[i] = new Edge();
+  for( int i = 0; i < nf; i++ ) faces[i] = new Face();
+
+#pragma omp parallel for
+  for( int i = 0; i < nv; i++ ) {
+    verts[i]->loc()    = sv[i]->loc();
+    verts[i]->normal() = sv[i]->normal();
+    verts[i]->edge()   = edges[ei[sv[i]->edge()->slot()]];
+    verts[i]->index()  = i;
+    verts[i]->slot()   = i;
+  }
+#pragma omp parallel for
+  for( int i = 0; i < ne; i++ ) {
+    Edge* e = se[i];
+    edges[i]->next()  = edges[ei[e->next()->slot()]];
+    edges[i]->prev()  = edges[ei[e->prev()->slot()]];
+    edges[i]->opp()   = edges[ei[e->opp()->slot()]];
+    edges[i]->vert()  = verts[vi[e->vert()->slot()]];
+    edges[i]->face()  = (e->face() != NULL) ? faces[fi[e->face()->slot()]] : NULL;
+    edges[i]->index() = i;
+    edges[i]->slot()  = i;
+  }
+#pragma omp parallel for
+  for( int i = 0; i < nf; i++ ) {
+    faces[i]->edge()   = edges[ei[sf[i]->edge()->slot()]];
+    faces[i]->normal() = sf[i]->normal();
+    faces[i]->index()  = i;
+    faces[i]->slot()   = i;
+  }
+
+  _verts.assign(verts.begin(), verts.end());
+  _edges.assign(edges.begin(), edges.end());
+  _faces.assign(faces.begin(), faces.end());
+  for( int i = 0; i < nf; i++ ) {
+    uint32_t c = m._face_to_color.find(sf[i])->second;
+    _color_to_face[c] = faces[i];
+    _face_to_color[faces[i]] = c;
+  }
+  // the copies get slot i and dense property arrays
+  std::vector<int> slots(nv);
+  for( int i = 0; i < nv; i++ ) slots[i] = sv[i]->slot();
+  _vprops = m._vprops.gather(slots);
+  slots.resize(ne);
+  for( int i = 0; i < ne; i++ ) slots[i] = se[i]->slot();
+  _eprops = m._eprops.gather(slots);
+  slots.resize(nf);
+  for( int i = 0; i < nf; i++ ) slots[i] = sf[i]->slot();
+  _fprops = m._fprops.gather(slots);
+  _version++;
+}
+
+void MeshObj::_take(MeshObj& m) {
+  _verts.swap(m._verts);
+  _edges.swap(m._edges);
+  _faces.swap(m._faces);
+  _color_to_face.swap(m._color_to_face);
+  _face_to_color.swap(m._face_to_color);
+  _vprops.swap(m._vprops);
+  _fprops.swap(m._fprops);
+  _eprops.swap(m._eprops);
+  _undo.swap(m._undo);
+  _redo.swap(m._redo);
+  _journaling = m._journaling;
+  _auto_reorder = m._auto_reorder;
+  _version = m._version + 1;
+  m._version++;
+}
+
+MeshSnapshot MeshObj::snapshot(void) {
+  if( _snapshot.empty() || _snapshot._version != _version ) {
+    MeshLoad::OBJMesh* obj = new MeshLoad::OBJMesh();
+    to_obj(*obj);
+    std::vector<uint32_t>* colors = new std::vector<uint32_t>();
+    colors->reserve(_faces.size());
+    for( FaceItr i = _faces.begin(); i != _faces.end(); i++ )
+      colors->push_back(_face_to_color[*i]);
+
+    std::vector<int> slots;
+    slots.reserve(_verts.size());
+    for( VertItr i = _verts.begin(); i != _verts.end(); i++ )
+      slots.push_back((*i)->slot());
+    PropertySet* vprops = new PropertySet(_vprops.gather(slots));
+    slots.clear();
+    for( FaceItr i = _faces.begin(); i != _faces.end(); i++ )
+      slots.push_back((*i)->slot());
+    PropertySet* fprops = new PropertySet(_fprops.gather(slots));
+    // the corners in the order of to_obj()
+    slots.clear();
+    for( FaceItr i = _faces.begin(); i != _faces.end(); i++ ) {
+      FaceEdgeRange r = (*i)->edges();
+      for( FaceEdgeRange::iterator e = r.begin(); e != r.end(); ++e )
+	slots.push_back(e->slot());
+    }
+    PropertySet* eprops = new PropertySet(_eprops.gather(slots));
+
+    _snapshot._obj.reset(obj);
+    _snapshot._colors.reset(colors);
+    _snapshot._vprops.reset(vprops);
+    _snapshot._fprops.reset(fprops);
+    _snapshot._eprops.reset(eprops);
+    _snapshot._version = _version;
+  }
+  return _snapshot;
+}
+
+unsigned int MeshObj::version(void) const { return _version; }
+
+void MeshObj::to_obj(MeshLoad::OBJMesh& m) {
+  index_elements();
+
+  m.pos.clear();  m.uv.clear();  m.nor.clear();
+  m.faces.clear();  m.face_startidx.clear();
+
+  m.pos.reserve(_verts.size());
+  for( VertItr i = _verts.begin(); i != _verts.end(); i++ )
+    m.pos.push_back((*i)->loc());
+
+  m.face_startidx.reserve(_faces.size());
+  m.faces.reserve(_edges.size());
+  for( FaceItr i = _faces.begin(); i != _faces.end(); i++ ) {
+    m.face_startidx.push_back(m.faces.size());
+    Edge* e = (*i)->edge();
+    do {
+      m.faces.push_back(MeshLoad::VTXindex(e->vert()->index(), -1, -1));
+      e = e->next();
+    } while( e != (*i)->edge() );
+  }
+  _export_corners(m);
+}
+
+void MeshObj::clear(void) {
+  _version++;
+  clear_history();
+  for( FaceItr i = _faces.begin(); i != _faces.end(); i++ ) delete *i;
+  for( EdgeItr i = _edges.begin(); i != _edges.end(); i++ ) delete *i;
+  for( VertItr i = _verts.begin(); i != _verts.end(); i++ ) delete *i;
+  _faces.clear();
+  _edges.clear();
+  _verts.clear();
+  _color_to_face.clear();
+  _face_to_color.clear();
+  _vprops.resize(0);
+  _fprops.resize(0);
+  _eprops.resize(0);
+}
+
+namespace {
+
+  /* Moves the values of the elements' slots in from to slots of to, and
+   * empties from. The removed elements keep their slots for undo; when
+   * none are kept, the arrays start over, else free slots are reused
+   * before they grow.
+   */
+  template <class T>
+  void take_slots(PropertySet& to, PropertySet& from, std::list<T*>& l) {
+    typename std::list<T*>::iterator i;
+    if( to.used() == 0 ) to.resize(0);
+    if( to.slots() == 0 && from.slots() == (int)l.size() )
+      to.append(from);                          // dense already
+    else {
+      to.append(from.gather(std::vector<int>()));   // the properties
+      for( i = l.begin(); i != l.end(); i++ ) {
+	int s = to.alloc();
+	to.put(s, from, (*i)->slot());
+	(*i)->slot() = s;
+      }
+    }
+    from.resize(0);
+  }
+};
+
+void MeshObj::replace(MeshObj& m) {
+  if( this == &m ) return;
+  JournalScope edit(this, true, true);
+
+  std::vector<Edge*> edges(_edges.begin(), _edges.end());
+  std::vector<Face*> faces(_faces.begin(), _faces.end());
+  std::vector<Vert*> verts(_verts.begin(), _verts.end());
+  std::vector<uint32_t> colors;
+  colors.reserve(faces.size());
+  for( int i = 0; i < (int)faces.size(); i++ )
+    colors.push_back(_face_to_color[faces[i]]);
+
+  _edges.clear();  _faces.clear();  _verts.clear();
+  _color_to_face.clear();
+  _face_to_color.clear();
+  _journal_dispose(edges, faces, colors, verts);
+
+  take_slots(_vprops, m._vprops, m._verts);
+  take_slots(_fprops, m._fprops, m._faces);
+  take_slots(_eprops, m._eprops, m._edges);
+
+  _verts.swap(m._verts);
+  _edges.swap(m._edges);
+  _faces.swap(m._faces);
+  _color_to_face.swap(m._color_to_face);
+  _face_to_color.swap(m._face_to_color);
+  m._version++;
+}
+
 const std::list<Edge*>& MeshObj::edges(void) const  { return _edges; }
 const std::list<Vert*>& MeshObj::verts(void) const  { return _verts; }
 const std::list<Face*>& MeshObj::faces(void) const  { return _faces; }
@@ -39,7 +352,38 @@ bool MeshObj::face_is_color(Face* f, uint32_t c) const {
   return _face_to_color.find(f)->second == c; 
 }
 
+bool MeshObj::find_pinches(const std::vector<int>& corners,
+			   const std::vector<int>& start, int nv,
+			   std::vector<char>& pinched) {
+  std::unordered_map<uint64_t, int> edge_uses;
+  std::vector<int> excess(nv, 0);
+  for( int f = 0; f + 1 < (int)start.size(); f++ )
+    for( int j = start[f]; j < start[f + 1]; j++ ) {
+      uint64_t a = corners[j];
+      uint64_t b = corners[j + 1 < start[f + 1] ? j + 1 : start[f]];
+      edge_uses[std::min(a, b) << 32 | std::max(a, b)]++;
+      excess[a]++;
+    }
+
+  // a vertex with k open fans has k more corners than shared edges
+  pinched.assign(nv, 0);
+  for( std::unordered_map<uint64_t, int>::iterator i = edge_uses.begin();
+       i != edge_uses.end(); i++ ) {
+    int a = i->first >> 32, b = i->first & 0xffffffff;
+    if( i->second > 2 ) pinched[a] = pinched[b] = 1;
+    else if( i->second == 2 ) { excess[a]--;  excess[b]--; }
+  }
+  bool any = false;
+  for( int v = 0; v < nv; v++ ) {
+    if( excess[v] >= 2 ) pinched[v] = 1;
+    any = any || pinched[v];
+  }
+  return any;
+}
+
 void MeshObj::convert_to_triangles(void) {
+  JournalScope edit(this, true);
+  _reorder_after_edit();
   FaceItr i = _faces.begin();
   FaceItr e = --_faces.end();
   while(true) {
@@ -53,23 +397,26 @@ void MeshObj::convert_to_triangles(void) {
 }
 
 void MeshObj::subdivide_faces(void) {
+  JournalScope edit(this, true);
+  _reorder_after_edit();
   VertContainer old_verts(_verts);
 
   // split all edges
   std::list<Vert*> new_verts;
   split_all_edges(new_verts);
   
-  // adjust the new vertices' locations
+  // adjust the new vertices' locations; the faces are hexagons now, so
+  // the old vertices opposite the edge are two steps on
   for( std::list<Vert*>::iterator i = new_verts.begin();
        i != new_verts.end(); i++ )
     {
       Vert* v = *i;
-      if( v->edge()->face() == NULL ) continue;
+      Edge* e = v->edge();
+      if( e->face() == NULL || e->opp()->face() == NULL ) continue;
       v->loc() = 
-	0.375 * (v->edge()->vert()->loc() + 
-		 v->edge()->opp()->next()->vert()->loc()) +
-	0.125 * (v->edge()->next()->vert()->loc() + 
-		 v->edge()->opp()->next()->next()->vert()->loc());
+	0.375 * (e->vert()->loc() + e->opp()->next()->vert()->loc()) +
+	0.125 * (e->next()->next()->vert()->loc() + 
+		 e->opp()->next()->next()->next()->vert()->loc());
     }
 
   // split all triangles into 4 triangles
@@ -95,13 +442,10 @@ void MeshObj::subdivide_faces(void) {
     {
       Vert* v = *i;
       Vec3f sum_new(0,0,0);
-      Edge* s = v->edge();  Edge* e = s;
       int k = 0;
-      do {
-	sum_new += e->vert()->loc();
-	e = e->opp()->next();
-	k++;
-      } while( e != s );
+      VertVertRange ring = v->neighbours();
+      for( VertVertRange::iterator w = ring.begin(); w != ring.end(); ++w, k++ )
+	sum_new += w->loc();
 
       if( k == 2 ) {
 	v->loc() = sum_new * 0.25 + v->loc() * 0.5;
@@ -121,38 +465,252 @@ void MeshObj::subdivide_faces(void) {
     (*i)->normal() = (*i)->calculate_normal();
 }
 
+// Catmull-Clark vertex point. Boundary vertices follow the boundary curve:
+// (prev + 6*v + next) / 8.
+static Vec3f cc_vert_point(const Vert* v) {
+  Edge* s = v->edge();
+
+  if( s->face() == NULL ) {
+    Edge* e = s->opp()->next();
+    while( e->opp()->face() != NULL && e != s ) e = e->opp()->next();
+    return (6 * v->loc() + s->vert()->loc() + e->vert()->loc()) / 8;
+  }
+
+  Vec3f face_sum(0,0,0), vert_sum(0,0,0);
+  int k = 0;
+  VertEdgeRange ring = v->edges();
+  for( VertEdgeRange::iterator e = ring.begin(); e != ring.end(); ++e, k++ ) {
+    face_sum += e->face()->centroid();
+    vert_sum += e->vert()->loc();
+  }
+
+  // (F + 2R + (k-3)P) / k, where 2R = P + average of the neighbours
+  return (face_sum / k + vert_sum / k + (k - 2) * v->loc()) / k;
+}
+
+void MeshObj::subdivide_catmull_clark(void) {
+  JournalScope edit(this, true);
+  _reorder_after_edit();
+  std::vector<Face*> old_faces(_faces.begin(), _faces.end());
+  std::vector<Vert*> old_verts(_verts.begin(), _verts.end());
+
+  // one half-edge per edge
+  std::vector<Edge*> old_edges;
+  old_edges.reserve(_edges.size() / 2);
+  for( EdgeItr i = _edges.begin(); i != _edges.end(); i++ )
+    if( *i < (*i)->opp() ) old_edges.push_back(*i);
+
+  int nf = old_faces.size();
+  int ne = old_edges.size();
+  int nv = old_verts.size();
+  std::vector<Vec3f> face_pts(nf), edge_pts(ne), vert_pts(nv);
+
+  // compute all new locations from the unmodified mesh
+#pragma omp parallel for
+  for( int i = 0; i < nf; i++ )
+    face_pts[i] = old_faces[i]->centroid();
+
+#pragma omp parallel for
+  for( int i = 0; i < ne; i++ ) {
+    Edge* e = old_edges[i];
+    Vec3f mid = (e->vert()->loc() + e->opp()->vert()->loc()) / 2;
+    if( e->external() ) 
+      edge_pts[i] = mid;
+    else 
+      edge_pts[i] = 0.5 * mid + 
+	0.25 * (e->face()->centroid() + e->opp()->face()->centroid());
+  }
+
+#pragma omp parallel for
+  for( int i = 0; i < nv; i++ )
+    vert_pts[i] = cc_vert_point(old_verts[i]);
+
+  // split all edges, then every (now 2n-sided) face into n quads
+  std::vector<Vert*> edge_verts;
+  edge_verts.reserve(ne);
+  split_edges(old_edges, edge_verts);
+
+  for( int i = 0; i < nf; i++ )
+    _quad_split(old_faces[i], face_pts[i]);
+
+#pragma omp parallel for
+  for( int i = 0; i < ne; i++ )
+    edge_verts[i]->loc() = edge_pts[i];
+
+#pragma omp parallel for
+  for( int i = 0; i < nv; i++ )
+    old_verts[i]->loc() = vert_pts[i];
+
+  // recalculate normals
+  std::vector<Face*> faces(_faces.begin(), _faces.end());
+  std::vector<Vert*> verts(_verts.begin(), _verts.end());
+
+#pragma omp parallel for
+  for( int i = 0; i < (int)faces.size(); i++ )
+    faces[i]->normal() = faces[i]->calculate_normal();
+
+#pragma omp parallel for
+  for( int i = 0; i < (int)verts.size(); i++ )
+    verts[i]->normal() = verts[i]->calculate_normal();
+}
+
+void MeshObj::_quad_split(Face* F, const Vec3f& center) {
+  // h[2j] ends at the j-th edge vertex, h[2j+1] at the j-th corner
+  std::vector<Edge*> h;
+  Edge* e = F->edge();
+  do { h.push_back(e); e = e->next(); } while( e != F->edge() );
+
+  if( h.size() % 2 != 0 ) 
+    throw "MeshObj::_quad_split(Face*, const Vec3f&): expected split edges.";
+
+  int n = h.size() / 2;
+  Vert* c = new Vert(center);
+  std::vector<Vert*> corners(n);
+  for( int j = 0; j < n; j++ ) corners[j] = h[2*j+1]->vert();
+  _add_slot(c, &corners[0], n);
+  // the corners at the center get the mean of the face's corners
+  std::vector<int> corner_slots(n);
+  for( int j = 0; j < n; j++ ) corner_slots[j] = h[2*j+1]->slot();
+  std::vector<Edge*> to_mid(n), to_center(n);
+  for( int j = 0; j < n; j++ ) {
+    to_mid[j]    = new Edge(h[2*j]->vert());
+    to_center[j] = new Edge(c);
+    _add_slot(to_mid[j], h[2*j]);
+    _add_slot(to_center[j], j == 0 ? NULL : to_center[0]);
+    if( j == 0 ) _eprops.mean(to_center[0]->slot(), &corner_slots[0], n);
+  }
+
+  for( int j = 0; j < n; j++ ) {
+    Edge* in  = h[2*j+1];
+    Edge* out = h[(2*j+2) % (2*n)];
+    Face* f = (j == 0) ? F : new Face();
+
+    to_mid[j]->next() = in;
+    in->next()        = out;
+    out->next()       = to_center[j];
+    to_center[j]->next() = to_mid[j];
+    in->prev()        = to_mid[j];
+    out->prev()       = in;
+    to_center[j]->prev() = out;
+    to_mid[j]->prev() = to_center[j];
+
+    to_mid[j]->face() = in->face() = out->face() = to_center[j]->face() = f;
+    f->edge() = in;
+
+    to_center[j]->opp() = to_mid[(j+1) % n];
+    to_mid[(j+1) % n]->opp() = to_center[j];
+
+    _edges.push_back(to_mid[j]);
+    _edges.push_back(to_center[j]);
+    if( f != F ) {
+      _add_slot(f, F);
+      _register_face(f);
+    }
+  }
+
+  c->edge() = to_mid[0];
+  _verts.push_back(c);
+}
+
 void MeshObj::split_all_edges(std::list<Vert*>& v) {
-  std::set<Edge*> edges(_edges.begin(), _edges.end());
-  std::set<Edge*>::iterator itr;
-  
-  while( edges.size() > 0 ) {
-    itr = edges.begin();
-    edges.erase((*itr)->opp());
-    v.push_back( split_edge(*itr) );
-    edges.erase(itr);
+  JournalScope edit(this, true);
+  std::vector<Edge*> edges;
+  edges.reserve(_edges.size() / 2);
+  for( EdgeItr i = _edges.begin(); i != _edges.end(); i++ )
+    if( *i < (*i)->opp() ) edges.push_back(*i);
+
+  std::vector<Vert*> new_verts;
+  split_edges(edges, new_verts);
+  v.insert(v.end(), new_verts.begin(), new_verts.end());
+}
+
+void MeshObj::split_edges(const std::vector<Edge*>& edges,
+			  std::vector<Vert*>& new_verts) {
+  JournalScope edit(this, true);
+  // both halves of an edge may be given; keep the first
+  index_elements();
+  std::vector<char> taken(_edges.size(), 0);
+  std::vector<Edge*> todo;
+  todo.reserve(edges.size());
+  for( int i = 0; i < (int)edges.size(); i++ ) {
+    Edge* e = edges[i];
+    if( taken[e->index()] ) continue;
+    taken[e->index()] = taken[e->opp()->index()] = 1;
+    todo.push_back(e);
+  }
+
+  // splits only touch the split edge and its opposite
+  int n = todo.size();
+  std::vector<Vert*> verts(n);
+#pragma omp parallel for
+  for( int i = 0; i < n; i++ )
+    verts[i] = _split_edge(todo[i]);
+
+  for( int i = 0; i < n; i++ ) {
+    Edge* e = todo[i];
+    if( e->next()->opp()->next()->opp() != e )
+      throw "MeshObj::split_edges(const std::vector<Edge*>&, "
+	"std::vector<Vert*>&): invalid cycle.";
+    _edges.push_back(e->next());
+    _edges.push_back(e->opp());
+    _verts.push_back(verts[i]);
+    Vert* ends[2] = { e->next()->vert(), e->opp()->vert() };
+    _add_slot(verts[i], ends, 2);
+    _add_slot(e->next(), e);
+    _add_slot(e->opp(), e->next()->opp());
+  }
+  // the second halves kept the old corners; a first half's prev() is the
+  // second half of an edge split in the same batch or an unchanged edge
+  for( int i = 0; i < n; i++ ) {
+    Edge* e = todo[i];
+    Edge* o = e->next()->opp();
+    _mean_slot(e, e->prev(), e->next());
+    _mean_slot(o, o->prev(), o->next());
   }
+  new_verts.insert(new_verts.end(), verts.begin(), verts.end());
 }
 
 Vert* MeshObj::split_edge(Edge *e) {
+  JournalScope edit(this, false);
+  _journal_touch_ring(e->vert());
+  _journal_touch_ring(e->opp()->vert());
+
+  Vert* v = _split_edge(e);
+  _edges.push_back(e->next());
+  _edges.push_back(e->opp());
+  _verts.push_back(v);
+  Vert* ends[2] = { e->next()->vert(), e->opp()->vert() };
+  _add_slot(v, ends, 2);
+  // the second halves keep the old corners, the first halves end at the
+  // midpoint
+  Edge* o = e->next()->opp();
+  _add_slot(e->next(), e);
+  _add_slot(e->opp(), o);
+  _mean_slot(e, e->prev(), e->next());
+  _mean_slot(o, o->prev(), o->next());
+
+  if( e->next()->opp()->next()->opp() != e )
+    throw "MeshObj::split_edge(Edge*): invalid cycle.";
+
+  return v;
+}
+
+Vert* MeshObj::_split_edge(Edge *e) {
   Edge* o = e->opp();
   Vert* v = new Vert((e->vert()->loc() + o->vert()->loc())/2);
 
   e->next() = new Edge(e->vert(), e->face(), e->next(), o);
   o->next() = new Edge(o->vert(), o->face(), o->next(), e);
+  e->next()->prev() = e;  e->next()->next()->prev() = e->next();
+  o->next()->prev() = o;  o->next()->next()->prev() = o->next();
   e->vert() = v;
   o->vert() = v;
-  _edges.push_back(e->next());
-  _edges.push_back(o->next());
 
   e->opp() = o->next();
   o->opp() = e->next();
   
   v->edge() = (o->face() == NULL) ? o->next() : e->next();
   v->normal() = v->calculate_normal();
-  _verts.push_back(v);
-
-  if( e->next()->opp()->next()->opp() != e )
-    throw "MeshObj::split_edge(Edge*): invalid cycle.";
 
   return v;
 }
@@ -172,30 +730,136 @@ void MeshObj::bisect_subdiv_triangle(Vert* v, Edge* e0,
   else if( e2->next() != e0 || e2->vert() != v )  //not 4 edges case
     throw "MeshObj::bisect_subdiv_triangle(): unexpected surface.";
 
+  JournalScope edit(this, false);
+  _journal_touch_face(e0->face());
+
   e1->face()->edge() = e1;
   Face* f2 = new Face(e2);
   Edge* e3 = new Edge(e2->vert(), e1->face(), e2->next(), NULL);
   Edge* e4 = new Edge(e1->vert(),         f2, e1->next(),   e3);
   e3->opp() = e4;
+  _add_slot(e3, e2);
+  _add_slot(e4, e1);
 
   if( six_case ) to_flip.push_back(e3);
   _edges.push_back(e3);
   _edges.push_back(e4);
 
-  e1->next() = e3;
-  e2->next() = e4;
+  e1->next() = e3;  e3->prev() = e1;  e3->next()->prev() = e3;
+  e2->next() = e4;  e4->prev() = e2;  e4->next()->prev() = e4;
 
   for( e2 = e4->next(); e2 != e4; e2 = e2->next() )
     e2->face() = f2;
 
   f2->normal() = f2->calculate_normal();
+  _add_slot(f2, e1->face());
   _register_face(f2);
 }
 
+bool MeshObj::flip_edge(Edge* e) {
+  if( !_flip_ok(e) ) return false;
+
+  JournalScope edit(this, false);
+  _journal_touch_face(e->face());
+  _journal_touch_face(e->opp()->face());
+  _edge_flip(e);
+  e->face()->normal() = e->face()->calculate_normal();
+  e->opp()->face()->normal() = e->opp()->face()->calculate_normal();
+  for( int i = 0; i < 2; i++, e = e->opp() ) {
+    e->vert()->normal() = e->vert()->calculate_normal();
+    e->next()->vert()->normal() = e->next()->vert()->calculate_normal();
+  }
+  return true;
+}
+
+int MeshObj::flip_edges(const std::vector<Edge*>& edges) {
+  JournalScope edit(this, true);
+  index_elements();
+  std::vector<char> flipped(_edges.size(), 0);
+  std::vector<char> locked(_verts.size(), 0);
+  std::vector<Edge*> pending(edges), rest, batch;
+  int count = 0;
+
+  while( !pending.empty() ) {
+    // greedy independent set: no two flips of a batch share a vertex
+    batch.clear();
+    rest.clear();
+    for( int i = 0; i < (int)pending.size(); i++ ) {
+      Edge* e = pending[i];
+      if( flipped[e->index()] || e->external() ) continue;
+      Vert* v[4] = { e->vert(), e->next()->vert(), 
+		     e->opp()->vert(), e->opp()->next()->vert() };
+      if( locked[v[0]->index()] || locked[v[1]->index()] ||
+	  locked[v[2]->index()] || locked[v[3]->index()] ) {
+	rest.push_back(e);
+	continue;
+      }
+      for( int j = 0; j < 4; j++ ) locked[v[j]->index()] = 1;
+      flipped[e->index()] = flipped[e->opp()->index()] = 1;
+      batch.push_back(e);
+    }
+
+    int n = batch.size();
+    std::vector<char> done(n, 0);
+#pragma omp parallel for reduction(+:count)
+    for( int i = 0; i < n; i++ ) {
+      Edge* e = batch[i];
+      if( !_flip_ok(e) ) continue;
+      _edge_flip(e);
+      e->face()->normal() = e->face()->calculate_normal();
+      e->opp()->face()->normal() = e->opp()->face()->calculate_normal();
+      done[i] = 1;
+      count++;
+    }
+
+    // vertex normals read the face normals of the whole batch
+#pragma omp parallel for
+    for( int i = 0; i < n; i++ ) {
+      Edge* e = batch[i];
+      if( done[i] ) {
+	e->vert()->normal() = e->vert()->calculate_normal();
+	e->next()->vert()->normal() = e->next()->vert()->calculate_normal();
+	e->opp()->vert()->normal() = e->opp()->vert()->calculate_normal();
+	e->opp()->next()->vert()->normal() = 
+	  e->opp()->next()->vert()->calculate_normal();
+      }
+    }
+
+    for( int i = 0; i < n; i++ ) {
+      Edge* e = batch[i];
+      locked[e->vert()->index()] = locked[e->next()->vert()->index()] = 0;
+      locked[e->opp()->vert()->index()] = 0;
+      locked[e->opp()->next()->vert()->index()] = 0;
+    }
+    pending.swap(rest);
+  }
+  return count;
+}
+
+bool MeshObj::_flip_ok(Edge* e) const {
+  Edge* o = e->opp();
+  if( e->face() == NULL || o->face() == NULL ) return false;
+  if( e->next()->next()->next() != e || o->next()->next()->next() != o )
+    return false;
+
+  // the new diagonal joins the tips of the two triangles
+  Vert* c = e->next()->vert();
+  Vert* d = o->next()->vert();
+  if( c == d ) return false;
+  VertVertRange ring = c->neighbours();
+  for( VertVertRange::iterator w = ring.begin(); w != ring.end(); ++w )
+    if( *w == d ) return false;
+  return true;
+}
+
 void MeshObj::_edge_flip(Edge* e1) {
   Edge* e2 = e1->opp();
   Edge* e11 = e1->next();  Edge* e12 = e11->next();
   Edge* e21 = e2->next();  Edge* e22 = e21->next();
+
+  // the flipped edges take the corners of the vertices they now end at
+  if( e1->slot() >= 0 && e21->slot() >= 0 ) _eprops.copy(e1->slot(), e21->slot());
+  if( e2->slot() >= 0 && e11->slot() >= 0 ) _eprops.copy(e2->slot(), e11->slot());
   
   e1->next() = e22;  e1->vert() = e21->vert();
   e2->next() = e12;  e2->vert() = e11->vert();
@@ -205,6 +869,9 @@ void MeshObj::_edge_flip(Edge* e1) {
   e21->next() = e2;
   e22->next() = e11;  e22->face() = e11->face();
 
+  e1->prev()  = e11;  e22->prev() = e1;  e11->prev() = e22;
+  e2->prev()  = e21;  e12->prev() = e2;  e21->prev() = e12;
+
   e12->face()->edge() = e12;
   e22->face()->edge() = e22;
 
@@ -212,6 +879,15 @@ void MeshObj::_edge_flip(Edge* e1) {
   if( e22->vert()->edge() == e2 )  e22->vert()->edge() = e11;
 }
 
+void MeshObj::index_elements(void) {
+  int n = 0;
+  for( VertItr i = _verts.begin(); i != _verts.end(); i++ ) (*i)->index() = n++;
+  n = 0;
+  for( EdgeItr i = _edges.begin(); i != _edges.end(); i++ ) (*i)->index() = n++;
+  n = 0;
+  for( FaceItr i = _faces.begin(); i != _faces.end(); i++ ) (*i)->index() = n++;
+}
+
 void MeshObj::_register_face(Face *f) {
   uint32_t key = (_color_to_face.size() == 0) ?
     1 : _color_to_face.rbegin()->first + 1;
@@ -220,6 +896,52 @@ void MeshObj::_register_face(Face *f) {
   _faces.push_back(f);
 }
 
+void MeshObj::_add_slot(Vert* v, Vert* const* from, int n) {
+  _journal_add(v);
+  v->slot() = _vprops.alloc();
+  std::vector<int> src(n);
+  for( int i = 0; i < n; i++ ) src[i] = from[i]->slot();
+  _vprops.mean(v->slot(), n > 0 ? &src[0] : NULL, n);
+}
+
+void MeshObj::_add_slot(Face* f, const Face* from) {
+  _journal_add(f);
+  f->slot() = _fprops.alloc();
+  if( from != NULL ) _fprops.copy(f->slot(), from->slot());
+}
+
+void MeshObj::_add_slot(Edge* e, const Edge* from) {
+  _journal_add(e);
+  e->slot() = _eprops.alloc();
+  if( from != NULL ) _eprops.copy(e->slot(), from->slot());
+}
+
+void MeshObj::_mean_slot(Edge* e, const Edge* a, const Edge* b) {
+  int src[2] = { a->slot(), b->slot() };
+  _eprops.mean(e->slot(), src, 2);
+}
+
+void MeshObj::_destroy(const std::vector<Edge*>& edges,
+		       const std::vector<Face*>& faces,
+		       const std::vector<Vert*>& verts) {
+  for( int i = 0; i < (int)faces.size(); i++ ) {
+    _fprops.free(faces[i]->slot());
+    delete faces[i];
+  }
+  for( int i = 0; i < (int)edges.size(); i++ ) {
+    _eprops.free(edges[i]->slot());
+    delete edges[i];
+  }
+  for( int i = 0; i < (int)verts.size(); i++ ) {
+    _vprops.free(verts[i]->slot());
+    delete verts[i];
+  }
+}
+
+PropertySet& MeshObj::vertex_properties(void) { return _vprops; }
+PropertySet& MeshObj::face_properties(void)   { return _fprops; }
+PropertySet& MeshObj::corner_properties(void) { return _eprops; }
+
 void MeshObj::_remove_edge(Edge* e) {
   EdgeItr i = std::find(_edges.begin(), _edges.end(), e);
   _edges.erase(i);
@@ -239,7 +961,25 @@ void MeshObj::face_to_triangles(uint32_t c) {
   face_to_triangles(_color_to_face[c]);
 }
 
+void MeshObj::faces_to_triangles(const std::set<uint32_t>& colors) {
+  // looked up first, as the split faces get new colors
+  std::vector<Face*> faces;
+  for( std::set<uint32_t>::const_iterator i = colors.begin(); 
+       i != colors.end(); i++ ) {
+    std::map<uint32_t, Face*>::iterator f = _color_to_face.find(*i);
+    if( f == _color_to_face.end() )
+      throw "MeshObj::faces_to_triangles(const std::set<uint32_t>&): no face matched color.";
+    faces.push_back(f->second);
+  }
+
+  JournalScope edit(this, false);
+  for( int i = 0; i < (int)faces.size(); i++ ) face_to_triangles(faces[i]);
+}
+
 void MeshObj::face_to_triangles(Face *F0) {
+  JournalScope edit(this, false);
+  _journal_touch_face(F0);
+
   Edge* e0 = F0->edge();
   Vert* o  = e0->vert();
 
@@ -253,13 +993,18 @@ void MeshObj::face_to_triangles(Face *F0) {
       //---------New Edge------- vert - face ------ next - opp -
       Edge* e3 = new Edge(          o,     f,         e1, NULL  );
       Edge* e4 = new Edge( e2->vert(),    F0, e2->next(), e3    );
+      _add_slot(e3, e0);
+      _add_slot(e4, e2);
       e0->next() = e4;
       e2->next() = e3;
+      e4->prev() = e0;  e4->next()->prev() = e4;
+      e3->prev() = e2;  e1->prev() = e3;
       e3->opp()  = e4;
       e1->face() = f;
       e2->face() = f;
 
       f->normal() = f->calculate_normal();
+      _add_slot(f, F0);
       _register_face(f);
       _edges.push_back(e3);
       _edges.push_back(e4);
@@ -267,80 +1012,136 @@ void MeshObj::face_to_triangles(Face *F0) {
 }
 
 bool MeshObj::delete_face(uint32_t color) {
-  Face* f = _color_to_face[color];
-  if( f == NULL ) throw "MeshObj::delete_face(uint32_t): no face matched color.";
-  
-  // check deletability
-  Edge* first = f->edge();  
-  Edge* e = first;
-  Edge* anchor = NULL;
-  do {
-    Edge* c = e;
-    e = e->next();
-    if( c->opp()->face() == NULL ) //edge on the boundary
-      continue;
-    else anchor = c;
-    if( c->vert()->edge()->face() != NULL ) //vertex not on the boundary
-      continue;
-    if( c->next()->opp()->face() == NULL ) //next edge on the boundary
-      continue;
+  if( _color_to_face.find(color) == _color_to_face.end() )
+    throw "MeshObj::delete_face(uint32_t): no face matched color.";
 
-    return false;
-  } while( e != first );
+  std::set<uint32_t> colors;
+  colors.insert(color);
+  return delete_faces(colors);
+}
 
-  // point edges into the dark abyss
-  Edge* n;
-  if( anchor == NULL ) { // no adjacent faces exist
-    do {
-      n = e->next();
-      _remove_vert(e->vert());
-      _remove_edge(e->opp());
-      _remove_edge(e);
-      e = n;
-    } while( e != first );
-  }
-  else {
-    first = anchor;
-    e = anchor;
-    
-    do {
-      n = e->next();
-      if( !e->external() ) {
-	if( n != first && n->external() ) {
-	  e->next() = e->vert()->edge();
-	}
-	else {
-	  e->vert()->edge() = n;
-	}
+// does the face exist and survive the deletion?
+static bool kept_face(const Face* f, const std::vector<char>& dead) {
+  return f != NULL && !dead[f->index()];
+}
+
+bool MeshObj::delete_faces(const std::set<uint32_t>& colors) {
+  index_elements();
+
+  std::vector<char> dead(_faces.size(), 0);
+  std::vector<Face*> dead_faces;
+  for( std::set<uint32_t>::const_iterator i = colors.begin(); 
+       i != colors.end(); i++ ) {
+    std::map<uint32_t, Face*>::iterator f = _color_to_face.find(*i);
+    if( f == _color_to_face.end() )
+      throw "MeshObj::delete_faces(const std::set<uint32_t>&): no face matched color.";
+    dead[f->second->index()] = 1;
+    dead_faces.push_back(f->second);
+  }
+  if( dead_faces.empty() ) return true;
+
+  // classify the vertices around the region: a vertex goes with its last
+  // face and may not be left with more than one fan of faces
+  std::vector<char> touched(_verts.size(), 0);
+  std::vector<Vert*> dead_verts, kept;
+  std::vector<Edge*> in_edges, out_edges;   // boundary edges at kept[i]
+  for( int i = 0; i < (int)dead_faces.size(); i++ ) {
+    FaceVertRange r = dead_faces[i]->verts();
+    for( FaceVertRange::iterator v = r.begin(); v != r.end(); ++v ) {
+      if( touched[v->index()] ) continue;
+      touched[v->index()] = 1;
+
+      // an outgoing edge separates e->face() and e->opp()->face()
+      int fans = 0;
+      Edge *in = NULL, *out = NULL;
+      VertEdgeRange ring = v->edges();
+      for( VertEdgeRange::iterator e = ring.begin(); e != ring.end(); ++e ) {
+	bool left = kept_face(e->face(), dead);
+	bool right = kept_face(e->opp()->face(), dead);
+	if( !left && right ) { fans++;  out = *e; }
+	if( left && !right ) in = e->opp();
       }
+
+      if( fans > 1 ) return false;
+      if( fans == 0 ) dead_verts.push_back(*v);
       else {
-	if( n != first && n->external() ) {
-	  _remove_vert(e->vert());
-	}
-	else {
-	  e->opp()->prev()->next() = n;
-	  e->vert()->edge() = n;
-	}
-	_remove_edge(e->opp());
-	_remove_edge(e);
+	kept.push_back(*v);
+	in_edges.push_back(in);
+	out_edges.push_back(out);
       }
-      e->face() = NULL;
-      e = n;
-    } while( e != first );
+    }
   }
 
-  _color_to_face.erase(color);
-  _face_to_color.erase(f);
-  _remove_face(f);
+  JournalScope edit(this, false);
+  for( int i = 0; i < (int)dead_verts.size(); i++ ) 
+    _journal_touch_ring(dead_verts[i]);
+  for( int i = 0; i < (int)kept.size(); i++ ) _journal_touch_ring(kept[i]);
+
+  // edges of the region with a face left become boundary, the others go
+  std::vector<Edge*> dead_edges;
+  for( int i = 0; i < (int)dead_faces.size(); i++ ) {
+    FaceEdgeRange r = dead_faces[i]->edges();
+    for( FaceEdgeRange::iterator e = r.begin(); e != r.end(); ++e ) {
+      if( kept_face(e->opp()->face(), dead) ) continue;
+      dead_edges.push_back(*e);
+      if( e->opp()->face() == NULL ) dead_edges.push_back(e->opp());
+    }
+  }
+  for( int i = 0; i < (int)dead_faces.size(); i++ ) {
+    Edge* s = dead_faces[i]->edge();
+    Edge* e = s;
+    do { e->face() = NULL;  e = e->next(); } while( e != s );
+  }
+
+  // rebuild the boundary loops: at each kept vertex the boundary edge
+  // coming in is followed by the one going out
+  for( int i = 0; i < (int)kept.size(); i++ ) {
+    in_edges[i]->next() = out_edges[i];
+    out_edges[i]->prev() = in_edges[i];
+    kept[i]->edge() = out_edges[i];
+  }
 
+  _purge(dead_edges, dead_faces, dead_verts);
+
+  for( int i = 0; i < (int)kept.size(); i++ )
+    kept[i]->normal() = kept[i]->calculate_normal();
   return true;
 }
 
-void MeshObj::construct(const MeshLoad::OBJMesh& m) {
+// frees a vector's buffer, not only its elements
+template <class T>
+static void release_vector(std::vector<T>& v) { std::vector<T>().swap(v); }
+
+void MeshObj::construct(const MeshLoad::OBJMesh& m, MeshLoad::OBJMesh* release) {
   std::vector<Vert*> verts;
+  verts.reserve(m.pos.size());
   for( std::vector<Vec3f>::const_iterator i = m.pos.begin(); 
        i != m.pos.end(); i++ )
     verts.push_back( new Vert(*i) );
+  if( release != NULL ) release_vector(release->pos);
+
+  // per-corner texture coordinates and normals; the i-th corner (of
+  // m.faces) gets slot i, and the boundary half-edges the slots after
+  int ne = m.faces.size();
+  _eprops.resize(ne);
+  if( !m.uv.empty() ) {
+    Property<Vec2f>& uv = _eprops.add<Vec2f>("uv", Vec2f(0,0));
+    for( int i = 0; i < (int)m.faces.size(); i++ ) {
+      int k = m.faces[i].uvIdx;
+      if( k >= 0 && k < (int)m.uv.size() ) uv[i] = m.uv[k];
+    }
+  }
+  if( !m.nor.empty() ) {
+    Property<Vec3f>& nor = _eprops.add<Vec3f>("nor", Vec3f(0,0,0));
+    for( int i = 0; i < (int)m.faces.size(); i++ ) {
+      int k = m.faces[i].norIdx;
+      if( k >= 0 && k < (int)m.nor.size() ) nor[i] = m.nor[k];
+    }
+  }
+  if( release != NULL ) {
+    release_vector(release->uv);
+    release_vector(release->nor);
+  }
   
   typedef pair<int, int> IndPair;
   map<IndPair, Edge*> edge_map;
@@ -349,14 +1150,20 @@ void MeshObj::construct(const MeshLoad::OBJMesh& m) {
   _color_to_face.clear();
   _face_to_color.clear();
 
-  for( int i=0; i<m.face_startidx.size(); i++ ) {
+  /* Faces are built from the last, so that a consumed m can give back
+   * its index buffers while the mesh grows. A vertex takes its edge from
+   * the last face around it, as when built in order.
+   */
+  std::vector<Face*> faces(m.face_startidx.size());
+  for( int i = (int)m.face_startidx.size() - 1; i >= 0; i-- ) {
 
     int endind = 
-      ( i < m.face_startidx.size() - 1 ) 
+      ( i < (int)m.face_startidx.size() - 1 ) 
       ? m.face_startidx[i+1] : m.faces.size();
     
     Face* face = new Face();
     Edge* first_edge = new Edge(verts[m.faces[m.face_startidx[i]].posIdx],face);
+    first_edge->slot() = m.face_startidx[i];
     Edge* current_edge = first_edge;
     face->edge() = first_edge;
 
@@ -366,8 +1173,10 @@ void MeshObj::construct(const MeshLoad::OBJMesh& m) {
 	int faces_ind = (j == endind) ? m.face_startidx[i] : j;
 	current_edge->next() = ( j == endind ) ? 
 	  first_edge : new Edge(verts[m.faces[j].posIdx], face);
-	current_edge->vert()->edge() = current_edge->next();
-	_edges.push_back(current_edge);
+	if( j < endind ) current_edge->next()->slot() = j;
+	current_edge->next()->prev() = current_edge;
+	if( current_edge->vert()->edge() == NULL )
+	  current_edge->vert()->edge() = current_edge->next();
 	
 	// if opposite is already in map
 	IndPair opp_key(m.faces[faces_ind].posIdx, m.faces[j-1].posIdx);
@@ -384,9 +1193,32 @@ void MeshObj::construct(const MeshLoad::OBJMesh& m) {
       }
 
     face->normal() = face->calculate_normal();
-    _register_face(face);
+    faces[i] = face;
+
+    // give back the consumed tail once it is half of the buffers
+    if( release != NULL ) {
+      release->faces.resize(m.face_startidx[i]);
+      release->face_startidx.resize(i);
+      if( release->faces.size() < release->faces.capacity() / 2 ) {
+	release->faces.shrink_to_fit();
+	release->face_startidx.shrink_to_fit();
+      }
+    }
+  }
+  if( release != NULL ) {
+    release_vector(release->faces);
+    release_vector(release->face_startidx);
   }
 
+  // the corners in order, each face's from its first
+  for( int i = 0; i < (int)faces.size(); i++ ) {
+    Edge* e = faces[i]->edge();
+    do {
+      _edges.push_back(e);
+      e = e->next();
+    } while( e != faces[i]->edge() );
+    _register_face(faces[i]);
+  }
 
   // handle boundaries
   // 1. create boundary edges, link opposites
@@ -403,8 +1235,10 @@ void MeshObj::construct(const MeshLoad::OBJMesh& m) {
   // 2. link boundary edges to next
   for( edge_map_itr = edge_map.begin();
        edge_map_itr != edge_map.end(); edge_map_itr++ ) {
+    edge_map_itr->second->opp()->slot() = ne++;
     edge_map_itr->second->opp()->next() = 
       edge_map_itr->second->opp()->vert()->edge();
+    edge_map_itr->second->opp()->next()->prev() = edge_map_itr->second->opp();
     _edges.push_back(edge_map_itr->second->opp());
     //edge_map.erase(edge_map_itr);
   }
@@ -412,6 +1246,14 @@ void MeshObj::construct(const MeshLoad::OBJMesh& m) {
 
   _verts.insert(_verts.begin(), verts.begin(), verts.end());
 
+  // the i-th vertex and face get slot i
+  int nf = 0;
+  for( FaceItr f = _faces.begin(); f != _faces.end(); f++ ) (*f)->slot() = nf++;
+  for( int i = 0; i < (int)verts.size(); i++ ) verts[i]->slot() = i;
+  _vprops.resize(verts.size());
+  _fprops.resize(nf);
+  _eprops.resize(ne);
+
   // computer per-vertex normals
   for( list<Vert*>::iterator vert_itr = _verts.begin(); 
        vert_itr != _verts.end(); vert_itr++ ) 
@@ -423,35 +1265,36 @@ void MeshObj::construct(const MeshLoad::OBJMesh& m) {
 ///////////////////////////////////////////////////////////////////////////////
 // class Edge
 
-Edge::Edge() : _next(NULL), _opp(NULL), _face(NULL), _vert(NULL)
+Edge::Edge() 
+  : _next(NULL), _prev(NULL), _opp(NULL), _face(NULL), _vert(NULL), _index(-1),
+    _slot(-1)
 {  }
 
 Edge::Edge( Vert* v, Face* f, Edge* n, Edge* o ) 
-  : _vert(v), _next(n), _opp(o), _face(f)
+  : _vert(v), _next(n), _prev(NULL), _opp(o), _face(f), _index(-1), _slot(-1)
 { }
 
 Edge::~Edge() {  }
 
 //getters
 Edge* Edge::next(void) const  { return _next; }
+Edge* Edge::prev(void) const  { return _prev; }
 Edge* Edge::opp (void) const  { return _opp;  }
 Face* Edge::face(void) const  { return _face; }
 Vert* Edge::vert(void) const  { return _vert; }
 
 //setter return "this" pointer
 Edge *& Edge::next(void)  { return _next; }
+Edge *& Edge::prev(void)  { return _prev; }
 Edge *& Edge::opp (void)  { return _opp;  }
 Face *& Edge::face(void)  { return _face; }
 Vert *& Edge::vert(void)  { return _vert; }
 
-Edge* Edge::prev(void) const {
-  Edge* e;
-  Vert* v = _opp->vert();
-  for( e = _opp; e->_next != this; e = e->_next->_opp ) {
-    if( e->vert() != v ) throw "Edge:prev(): unexpected vertex found.";
-  }
-  return e;
-}
+int  Edge::index(void) const { return _index; }
+int& Edge::index(void)       { return _index; }
+
+int  Edge::slot(void) const { return _slot; }
+int& Edge::slot(void)       { return _slot; }
 
 bool Edge::external(EdgeType t) {
   switch( t ) 
@@ -470,10 +1313,10 @@ std::ostream& operator << (std::ostream& s, const Edge& e) {
 ///////////////////////////////////////////////////////////////////////////////
 // class Face
 
-Face::Face() : _edge(NULL)
+Face::Face() : _edge(NULL), _index(-1), _slot(-1)
 {  }
 
-Face::Face( Edge* e ) : _edge(e)
+Face::Face( Edge* e ) : _edge(e), _index(-1), _slot(-1)
 {  }
 
 Face::~Face() {  }
@@ -484,6 +1327,12 @@ const Vec3f& Face::normal(void) const  { return _normal; }
 Edge*& Face::edge  (void) { return _edge;   }
 Vec3f& Face::normal(void) { return _normal; }
 
+int  Face::index(void) const { return _index; }
+int& Face::index(void)       { return _index; }
+
+int  Face::slot(void) const { return _slot; }
+int& Face::slot(void)       { return _slot; }
+
 Vec3f Face::calculate_normal(void) const {
   Edge* ne = _edge->next();         //next edge
   Edge* nne = ne->next();           //next next edge
@@ -492,6 +1341,14 @@ Vec3f Face::calculate_normal(void) const {
   return cross(v1, v2);
 }
 
+Vec3f Face::centroid(void) const {
+  Vec3f c(0,0,0);  int n = 0;
+  FaceVertRange r = verts();
+  for( FaceVertRange::iterator v = r.begin(); v != r.end(); ++v, n++ )
+    c += v->loc();
+  return c / n;
+}
+
 unsigned int Face::edge_count(void) const {
   Edge *e;  int n = 1;
   for( e = _edge->next(); e != _edge; e = e->next() ) n++;
@@ -502,10 +1359,10 @@ unsigned int Face::edge_count(void) const {
 ///////////////////////////////////////////////////////////////////////////////
 // class Vert
 
-Vert::Vert() : _edge(NULL)
+Vert::Vert() : _edge(NULL), _index(-1), _slot(-1)
 {  }
 
-Vert::Vert(const Vec3f& v) : _edge(NULL), _loc(v)
+Vert::Vert(const Vec3f& v) : _edge(NULL), _loc(v), _index(-1), _slot(-1)
 {  }
 
 Vert::~Vert() {  }
@@ -518,32 +1375,24 @@ Vec3f& Vert::loc   (void) { return _loc;    }
 Vec3f& Vert::normal(void) { return _normal; }
 Edge*& Vert::edge  (void) { return _edge;   }
 
+int  Vert::index(void) const { return _index; }
+int& Vert::index(void)       { return _index; }
+
+int  Vert::slot(void) const { return _slot; }
+int& Vert::slot(void)       { return _slot; }
+
 Vec3f Vert::calculate_normal(void) const {
   Vec3f n(0,0,0);
-  list<Face*> faces = list_faces();
-  for(list<Face*>::const_iterator face_itr = faces.begin();
-      face_itr != faces.end(); face_itr++ )
-    {
-      n += (*face_itr)->normal();
-    }
+  VertFaceRange r = faces();
+  for( VertFaceRange::iterator f = r.begin(); f != r.end(); ++f )
+    n += f->normal();
   return n;
 }
 
-list<Face*> Vert::list_faces(void) const {
-  list<Face*> l;
-  Edge *first, *e;
-  first = e = _edge;
-  do {
-    if( e->face() != NULL )  l.push_back(e->face());
-    e = e->opp()->next();
-  } while (e != first);
-  return l;
-}
-
 int Vert::count_adjacent(void) const {
-  Edge* e = _edge->opp()->next();
-  int i = 1;
-  while( e != _edge ) { e = e->opp()->next(); i++; }
+  int i = 0;
+  VertEdgeRange r = edges();
+  for( VertEdgeRange::iterator e = r.begin(); e != r.end(); ++e ) i++;
   return i;
 }
 
@@ -589,6 +1438,11 @@ bool MeshObj::validate(void) {
       ok = false;  _DEBUG cout << "x ";
     } else _DEBUG cout << ". ";
 
+    // check the prev link
+    if( e->next()->prev() != e ) {
+      ok = false;  _DEBUG cout << "x ";
+    } else _DEBUG cout << ". ";
+
     // check opposites
     if( e->opp()->opp() != e ) {
       ok = false;  _DEBUG cout << "x ";
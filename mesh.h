@@ -4,13 +4,16 @@
 #define _DEBUG if(false)
 
 #include <cstddef>         //for NULL
+#include <cfloat>          //for FLT_MAX
 #include <algorithm>
 #include <list>
 #include <vector>
 #include <utility>
 #include <map>
 #include <set>
+#include <memory>
 #include "mesh-loader.h"
+#include "mesh-props.h"
 #include "headers.h"
 
 using std::vector;
@@ -23,6 +26,50 @@ using std::endl;
 class Edge;
 class Face;
 class Vert;
+struct JournalRecord;
+
+// one-ring and face-loop circulators, defined at the end of this file
+namespace Circ {
+  struct AroundVert;
+  struct AroundFace;
+  struct GetEdge;
+  struct GetFace;
+  struct GetVert;
+};
+template <class Step, class Get> class CircRange;
+
+typedef CircRange<Circ::AroundVert, Circ::GetEdge> VertEdgeRange;
+typedef CircRange<Circ::AroundVert, Circ::GetFace> VertFaceRange;
+typedef CircRange<Circ::AroundVert, Circ::GetVert> VertVertRange;
+typedef CircRange<Circ::AroundFace, Circ::GetEdge> FaceEdgeRange;
+typedef CircRange<Circ::AroundFace, Circ::GetVert> FaceVertRange;
+
+//-----------------------------------------------------------------------------
+
+/* An immutable copy of a mesh as flat arrays (vertices in verts() order,
+ * faces in faces() order with their colors). Copies share the arrays, and
+ * MeshObj::snapshot() hands out the same arrays until the mesh is edited,
+ * so snapshots are cheap to take and safe to read from another thread.
+ */
+class MeshSnapshot {
+ public:
+  MeshSnapshot();
+
+  bool empty(void) const;
+  const MeshLoad::OBJMesh&     obj(void) const;
+  const std::vector<uint32_t>& colors(void) const;
+  // the MeshObj::version() the snapshot was taken at
+  unsigned int version(void) const;
+
+ private:
+  friend class MeshObj;
+  std::shared_ptr<const MeshLoad::OBJMesh> _obj;
+  std::shared_ptr<const std::vector<uint32_t> > _colors;
+  // the properties, slot i for the i-th vertex, face or corner (of
+  // obj().faces)
+  std::shared_ptr<const PropertySet> _vprops, _fprops, _eprops;
+  unsigned int _version;
+};
 
 //-----------------------------------------------------------------------------
 
@@ -40,7 +87,38 @@ class MeshObj {
  public:
   MeshObj();
   MeshObj(const MeshLoad::OBJMesh& m);
+  // as above, freeing m's buffers as soon as they are used up
+  MeshObj(MeshLoad::OBJMesh&& m);
   MeshObj(const char* filename);
+  // rebuilds the mesh of a snapshot, face colors included
+  MeshObj(const MeshSnapshot& s);
+
+  /* Copies are deep (the edit history is not copied); moves take the
+   * elements and the history over and leave the source empty.
+   */
+  MeshObj(const MeshObj& m);
+  MeshObj(MeshObj&& m);
+  MeshObj& operator=(const MeshObj& m);
+  MeshObj& operator=(MeshObj&& m);
+  ~MeshObj();
+
+  /* see MeshSnapshot */
+  MeshSnapshot snapshot(void);
+  // changes with every edit
+  unsigned int version(void) const;
+
+  /* copies the mesh into m, vertices in verts() order (see index()), with
+   * the corner properties "uv" and "nor" as texture coordinates and normals
+   */
+  void to_obj(MeshLoad::OBJMesh& m);
+
+  /* deletes all elements */
+  void clear(void);
+
+  /* Takes m's elements in place of this mesh's, leaving m empty. This is
+   * one undoable edit, so edits made on a copy can be swapped back in.
+   */
+  void replace(MeshObj& m);
 
   // getters for constant iterators to mesh elements
   const std::list<Edge*>& edges(void) const;
@@ -53,10 +131,30 @@ class MeshObj {
   uint32_t face_to_color(Face *) const;
   bool face_is_color(Face*, uint32_t) const;
 
+  /* Marks the vertices 0..nv-1 which a MeshObj built from these faces would
+   * pinch: more than one fan of faces, or on an edge of more than two
+   * faces. Face f has the corners start[f] .. start[f+1]-1. Returns
+   * whether any vertex is pinched.
+   */
+  static bool find_pinches(const std::vector<int>& corners,
+			   const std::vector<int>& start, int nv,
+			   std::vector<char>& pinched);
+
   /* ALTERATION INTERFACE */
   void convert_to_triangles(void);
   bool delete_face(uint32_t color);   //returns true on success, false on failure
+
+  /* Deletes a region of faces at once. Returns false (and leaves the mesh
+   * untouched) if a vertex would be left with two separate fans of faces.
+   * Vertices and edges left without faces are deleted.
+   */
+  bool delete_faces(const std::set<uint32_t>& colors);
   void subdivide_faces(void);         //expects an all-triangle mesh
+
+  /* Catmull-Clark subdivision. Works on arbitrary polygons (every n-gon
+   * becomes n quads) and uses the crease rules along boundaries.
+   */
+  void subdivide_catmull_clark(void);
   
   /* returns the new vector which splits the edge 
    * (automatically adds that vector to the mesh) 
@@ -67,6 +165,25 @@ class MeshObj {
    */
   void split_all_edges(std::list<Vert*>&);
 
+  /* Splits many edges at once (each edge once, whichever half is given).
+   * The new vertices are created in parallel and appended to new_verts in
+   * the order of the edges.
+   */
+  void split_edges(const std::vector<Edge*>& edges,
+		   std::vector<Vert*>& new_verts);
+
+  /* Flips an edge between two triangles. Returns false (and leaves the
+   * mesh untouched) if the edge is on the boundary, a face is not a
+   * triangle or the new diagonal already exists.
+   */
+  bool flip_edge(Edge *);
+
+  /* Flips many edges at once. Flips which share a vertex conflict, so the
+   * edges are grouped into independent sets which are flipped in parallel,
+   * one set after the other. Returns the number of edges flipped.
+   */
+  int flip_edges(const std::vector<Edge*>& edges);
+
   /* Bisects the triangle on the Edge side of the Vertex.
    * Expects 6 or 4 sides to the figure.
    * If it finds a polygon with 6 sides, it adds the new edge to the to_flip list.
@@ -75,23 +192,263 @@ class MeshObj {
 
   void face_to_triangles(Face *);   //use the version with uint32_t arg instead
   void face_to_triangles(uint32_t);
+  /* splits many faces into triangles as one edit */
+  void faces_to_triangles(const std::set<uint32_t>& colors);
+
+  /* Quadric error decimation by half-edge collapses (mesh-decimate.cpp).
+   * Collapses the cheapest edges until the mesh has target_faces faces or
+   * the cheapest remaining collapse costs more than max_error. With
+   * lock_boundary, boundary vertices are neither moved nor removed.
+   * Expects an all-triangle mesh. Returns the number of collapses.
+   */
+  int decimate(unsigned int target_faces, float max_error = FLT_MAX,
+	       bool lock_boundary = false);
+
+  /* Collapses the half-edge's origin into its vert(). Returns false (and
+   * leaves the mesh untouched) if the collapse would break the topology.
+   */
+  bool collapse_edge(Edge *);
+  /* Collapses the half-edges in turn like collapse_edge(), skipping those
+   * removed or refused on the way, and takes the removed elements out of
+   * the containers once. Returns the number of collapses.
+   */
+  int collapse_edges(const std::vector<Edge*>&);
+
+  /* Isotropic remeshing (mesh-remesh.cpp) towards edges of target_length.
+   * Each iteration splits long edges, collapses short ones, flips edges
+   * towards valence 6 (4 on the boundary) and relaxes the vertices within
+   * their tangent planes; every phase works in parallel batches. Boundary
+   * vertices are kept in place. Expects an all-triangle mesh.
+   */
+  void remesh(float target_length, int iterations = 5);
+  float mean_edge_length(void) const;
+
+  /* Umbrella smoothing (mesh-remesh.cpp): each iteration moves every
+   * interior vertex by lambda towards the centroid of its neighbours, all
+   * at once. Boundary vertices are kept in place. Works on any polygons.
+   */
+  void smooth(int iterations = 1, float lambda = 0.5);
+
+  /* CONNECTED COMPONENTS (mesh-components.cpp): faces which share an edge
+   * are in the same component.
+   */
+  struct Component {
+    unsigned int faces;
+    float area;
+    Vec3f lo, hi;                   // bounding box
+  };
+
+  /* Labels the components by a parallel union-find over the opp() links
+   * and returns their number. face_ids and vert_ids are indexed by index()
+   * (the elements are indexed anew), stats by component. Components are
+   * numbered in faces() order.
+   */
+  int label_components(std::vector<int>& face_ids, std::vector<int>& vert_ids,
+		       std::vector<Component>& stats);
+  /* One mesh per component, face colors kept. The parts are built in
+   * parallel and can be edited, validated or exported on separate threads.
+   */
+  void split_components(std::vector<MeshObj>& parts);
+  /* Deletes the components with fewer than min_faces faces (as one edit).
+   * Returns the number of components deleted.
+   */
+  int remove_small_components(unsigned int min_faces);
+
+  /* HOLES (mesh-holes.cpp): the boundary half-edges (face() == NULL) form
+   * one loop per hole (or border of an open mesh).
+   */
+  struct BoundaryLoop {
+    Edge* edge;                     // one of the loop's boundary half-edges
+    unsigned int length;            // number of edges
+    float perimeter;
+  };
+
+  void boundary_loops(std::vector<BoundaryLoop>& loops);
+  /* Fills the holes with at most max_edges edges (0: all of them) by a
+   * minimum-area triangulation. With refine, the patch gets vertices until
+   * its triangles match the edge lengths around the hole; with fair, those
+   * vertices are smoothed. Holes are filled in parallel. Returns the number
+   * of holes filled; a hole whose border vertices are joined too often to
+   * be triangulated is left open.
+   */
+  int fill_holes(unsigned int max_edges = 0, bool refine = true, 
+		 bool fair = true);
+
+  /* PROPERTIES (mesh-props.h): named values of any type per vertex, per
+   * face and per corner, kept in dense arrays indexed by Vert::slot(),
+   * Face::slot() and Edge::slot() (a property can be indexed by the element
+   * itself: uv[v]). The corner of a half-edge e is e->vert() in e->face(),
+   * so a vertex has one value per adjacent face and seams are kept. Edits
+   * give a new vertex or corner the mean of those it is made from (an edge
+   * midpoint the mean of the edge's ends, a face center that of the
+   * corners), a face split off another face that face's values, and faces
+   * filling holes the defaults. Meshes read from OBJ files with texture
+   * coordinates or normals get the corner properties "uv" (Vec2f) and
+   * "nor" (Vec3f). Corner values are journaled with the edges; vertex and
+   * face values are not, but undone elements come back with theirs.
+   */
+  template <class T> 
+  Property<T>& add_vertex_property(const std::string& name, const T& def = T())
+    { return _vprops.add<T>(name, def); }
+  template <class T> Property<T>* vertex_property(const std::string& name)
+    { return _vprops.get<T>(name); }
+  template <class T> 
+  Property<T>& add_face_property(const std::string& name, const T& def = T())
+    { return _fprops.add<T>(name, def); }
+  template <class T> Property<T>* face_property(const std::string& name)
+    { return _fprops.get<T>(name); }
+  template <class T> 
+  Property<T>& add_corner_property(const std::string& name, const T& def = T())
+    { return _eprops.add<T>(name, def); }
+  template <class T> Property<T>* corner_property(const std::string& name)
+    { return _eprops.get<T>(name); }
+  PropertySet& vertex_properties(void);
+  PropertySet& face_properties(void);
+  PropertySet& corner_properties(void);
+
+  /* UNDO INTERFACE (mesh-journal.cpp). While journaling is on, every edit
+   * is recorded: local edits as the states of the elements they touch,
+   * whole-mesh edits (subdivision, triangulation, decimation, remeshing,
+   * batched splits and flips) as a snapshot of all elements. The last
+   * MAX_RECORDS edits can be undone. Journaling is off by default.
+   */
+  void set_journaling(bool on);
+  bool undo(void);                  //returns false if there is nothing to undo
+  bool redo(void);                  //returns false if there is nothing to redo
+  bool can_undo(void) const;
+  bool can_redo(void) const;
+  void clear_history(void);
+
+  /* makes the edits up to the matching end_edit() one undo step */
+  void begin_edit(void);
+  void end_edit(void);
+
+  /* REORDERING (mesh-reorder.cpp): rebuilds the elements along a Morton
+   * curve through the bounding box (vertices by position, faces by their
+   * centroid, half-edges face by face and then the boundary), so elements
+   * which are close on the surface are close in memory, property values
+   * included. One undoable edit; element pointers are invalidated, face
+   * colors are kept. With auto reorder on, triangulation, subdivision,
+   * decimation, remeshing, hole filling and debris removal end with a
+   * reorder (within their undo step). Off by default.
+   */
+  void reorder(void);
+  void set_auto_reorder(bool on);
+  bool auto_reorder(void) const;
+
+  /* numbers the elements of each container in order (see index()) */
+  void index_elements(void);
   
   bool validate(void);
 
  private:
   // Performs an edge flip. Expects the edge to be between two triangles.
   void _edge_flip(Edge*);
+  // Checks the conditions flip_edge() documents.
+  bool _flip_ok(Edge*) const;
+
+  // Splits the edge without adding the new elements to the containers.
+  Vert* _split_edge(Edge*);
+
+  // Splits a face whose edges have all been split (2n sides) into n quads
+  // around a new vertex placed at the given location.
+  void _quad_split(Face*, const Vec3f& center);
 
   // faces are ID'd by a unique RGBA value stored as a CVec4T
   std::map<uint32_t, Face*> _color_to_face;
   std::map<Face*, uint32_t> _face_to_color;
 
+  // Checks the link condition for collapsing the half-edge.
+  bool _collapse_ok(Edge*) const;
+  // Collapses without checks, returns the removed vertex. Removed edges and
+  // faces are appended to the lists but not taken out of the containers.
+  Vert* _collapse(Edge*, std::vector<Edge*>& dead_edges,
+		  std::vector<Face*>& dead_faces);
+  // Would moving the origin onto vert() flip one of the remaining faces?
+  bool _collapse_flips(Edge*) const;
+  // Takes the elements out of the containers in one pass and deletes them.
+  void _purge(const std::vector<Edge*>& dead_edges,
+	      const std::vector<Face*>& dead_faces,
+	      const std::vector<Vert*>& dead_verts);
+
+  // the phases of remesh()
+  void _split_long_edges(float max_length);
+  void _collapse_short_edges(float min_length, float max_length);
+  void _equalize_valences(void);
+  void _relax_tangentially(void);
+
+  // Closes the hole of the boundary loop at the edge. The new elements are
+  // returned, not added to the containers. Returns false if it cannot.
+  bool _fill_hole(Edge*, bool refine, bool fair, std::vector<Edge*>& edges,
+		  std::vector<Face*>& faces, std::vector<Vert*>& verts);
+
+  // Journal: edits run in a JournalScope and touch the elements they are
+  // about to change; removed elements go to _journal_dispose().
+  class JournalScope {
+   public:
+    // replaces: the edit removes every element without changing it
+    JournalScope(MeshObj*, bool snapshot, bool replaces = false);
+    ~JournalScope();
+   private:
+    MeshObj* _mesh;
+    int _exceptions;                // in flight when the scope began
+  };
+  void _journal_begin(bool snapshot, bool replaces = false);
+  // an edit left by an exception is not reordered
+  void _journal_end(bool unwinding = false);
+  void _journal_add(const void*);    // an element made by the edit
+  void _journal_touch_face(Face*);   // the face, its edges and vertices
+  void _journal_touch_ring(Vert*);   // the vertex and its adjacent faces
+  void _journal_dispose(const std::vector<Edge*>&, const std::vector<Face*>&,
+			const std::vector<uint32_t>& colors,
+			const std::vector<Vert*>&);
+  // frees what a record owns: a done edit the elements it removed, an
+  // undone one those it added
+  void _journal_drop(JournalRecord*, bool done);
+
+  bool _journaling;
+  int _journal_depth;
+  JournalRecord* _record;           // the edit being recorded
+  std::vector<JournalRecord*> _undo, _redo;
+
+  // bulk edits ask for a reorder (with auto reorder on), which is done at
+  // the end of the outermost edit
+  void _reorder_after_edit(void);
+  int _edit_depth;
+  bool _auto_reorder, _reorder_pending;
+
   void _register_face(Face*);
   void _remove_edge(Edge*);
   void _remove_vert(Vert*);
   void _remove_face(Face*);
 
-  void construct(const MeshLoad::OBJMesh &);
+  // release: m itself, to free its buffers along the way, or NULL
+  void construct(const MeshLoad::OBJMesh &, MeshLoad::OBJMesh* release = NULL);
+  // copies m's elements into this (empty) mesh, in the given order
+  void _copy(const MeshObj& m);
+  void _copy(const MeshObj& m, const std::vector<Vert*>&,
+	     const std::vector<Edge*>&, const std::vector<Face*>&);
+  // takes m's elements and history, leaving m empty
+  void _take(MeshObj& m);
+
+  // Gives a new vertex a slot with the mean of the n vertices' values,
+  // a new face one with the values of the face it was split from.
+  void _add_slot(Vert*, Vert* const* from, int n);
+  void _add_slot(Face*, const Face* from);
+  // a new corner one with the values of the corner from (the defaults
+  // without one); _mean_slot() sets a corner to the mean of a and b
+  void _add_slot(Edge*, const Edge* from);
+  void _mean_slot(Edge*, const Edge* a, const Edge* b);
+  // fills in the uv and normal indices of the corners to_obj() wrote
+  void _export_corners(MeshLoad::OBJMesh& m);
+  // deletes elements for good, freeing their slots
+  void _destroy(const std::vector<Edge*>&, const std::vector<Face*>&,
+		const std::vector<Vert*>&);
+
+  PropertySet _vprops, _fprops, _eprops;
+
+  unsigned int _version;
+  MeshSnapshot _snapshot;           // the last snapshot, shared while current
 
   VertContainer _verts;
   EdgeContainer _edges;
@@ -114,23 +471,36 @@ class Edge {
   Face* face(void) const;
   Vert* vert(void) const;
 
+  // the edge whose next() this is; kept by every topology operation
   Edge* prev(void) const;
 
   bool external(EdgeType = DOUBLE_EDGE);
 
   //setter return "this" pointer
   Edge *& next(void);
+  Edge *& prev(void);
   Edge *&  opp(void);
   Face *& face(void);
   Vert *& vert(void);
 
+  // position in MeshObj::edges() as of the last MeshObj::index_elements()
+  int  index(void) const;
+  int& index(void);
+
+  // slot in the corner properties of the mesh
+  int  slot(void) const;
+  int& slot(void);
+
   friend std::ostream& operator << (std::ostream& s, const Edge& e);
 
  private:
   Edge *_next;
+  Edge *_prev;
   Edge *_opp;
   Face *_face;
   Vert *_vert;
+  int   _index;
+  int   _slot;
 };
 
 //-----------------------------------------------------------------------------
@@ -146,15 +516,30 @@ class Face {
   const Vec3f& normal(void) const;
 
   Vec3f calculate_normal(void) const;
+  Vec3f centroid(void) const;
   unsigned int edge_count(void) const;
 
+  // the edges of the face (in next() order) and the vertices they point to
+  FaceEdgeRange edges(void) const;
+  FaceVertRange verts(void) const;
+
   //setter 
   Edge*& edge(void);
   Vec3f& normal(void);
 
+  // position in MeshObj::faces() as of the last MeshObj::index_elements()
+  int  index(void) const;
+  int& index(void);
+
+  // slot in the face properties of the mesh
+  int  slot(void) const;
+  int& slot(void);
+
  private:
   Edge *_edge;
   Vec3f _normal;
+  int   _index;
+  int   _slot;
 };
 
 //-----------------------------------------------------------------------------
@@ -177,8 +562,20 @@ class Vert {
   Vec3f& normal(void);
   Edge*& edge  (void);
 
-  //lists
-  list<Face*> list_faces(void) const;
+  // position in MeshObj::verts() as of the last MeshObj::index_elements()
+  int  index(void) const;
+  int& index(void);
+
+  // slot in the vertex properties of the mesh
+  int  slot(void) const;
+  int& slot(void);
+
+  // the outgoing half-edges, the adjacent faces (none for the gap along
+  // the boundary) and the neighbouring vertices
+  VertEdgeRange edges(void) const;
+  VertFaceRange faces(void) const;
+  VertVertRange neighbours(void) const;
+
   int count_adjacent(void) const;
   
   friend std::ostream& operator << (std::ostream& s, const Vert& v);
@@ -187,6 +584,88 @@ class Vert {
   Vec3f _loc;
   Vec3f _normal;
   Edge *_edge;
+  int   _index;
+  int   _slot;
 };
 
+//-----------------------------------------------------------------------------
+
+/* Circulators walk around a vertex (e->opp()->next()) or a face (e->next())
+ * from a starting half-edge until they are back at it, without allocating.
+ * Elements which do not exist (the faces of boundary half-edges) are
+ * skipped. A range hands out begin() and end() circulators:
+ *
+ *   VertFaceRange r = v->faces();
+ *   for( VertFaceRange::iterator f = r.begin(); f != r.end(); ++f )
+ *     n += f->normal();
+ */
+namespace Circ {
+  struct AroundVert { static Edge* step(Edge* e) { return e->opp()->next(); } };
+  struct AroundFace { static Edge* step(Edge* e) { return e->next(); } };
+
+  struct GetEdge {
+    typedef Edge value_type;
+    static Edge* get(Edge* e) { return e; }
+  };
+  struct GetFace {
+    typedef Face value_type;
+    static Face* get(Edge* e) { return e->face(); }
+  };
+  struct GetVert {
+    typedef Vert value_type;
+    static Vert* get(Edge* e) { return e->vert(); }
+  };
+};
+
+template <class Step, class Get>
+class Circulator {
+ public:
+  typedef typename Get::value_type value_type;
+
+  // an end circulator has gone around once
+  Circulator(Edge* start, bool end) 
+    : _start(start), _e(start), _laps((end || start == NULL) ? 1 : 0) 
+  { _skip(); }
+
+  value_type* operator* (void) const { return Get::get(_e); }
+  value_type* operator->(void) const { return Get::get(_e); }
+  // the half-edge the circulator is at
+  Edge* edge(void) const { return _e; }
+
+  Circulator& operator++(void) { _step(); _skip(); return *this; }
+
+  bool operator==(const Circulator& c) const 
+  { return _e == c._e && _laps == c._laps; }
+  bool operator!=(const Circulator& c) const { return !(*this == c); }
+
+ private:
+  void _step(void) { _e = Step::step(_e);  if( _e == _start ) _laps++; }
+  void _skip(void) { while( _laps == 0 && Get::get(_e) == NULL ) _step(); }
+
+  Edge* _start;
+  Edge* _e;
+  int   _laps;
+};
+
+template <class Step, class Get>
+class CircRange {
+ public:
+  typedef Circulator<Step, Get> iterator;
+
+  explicit CircRange(Edge* start) : _start(start) {  }
+
+  iterator begin(void) const { return iterator(_start, false); }
+  iterator end  (void) const { return iterator(_start, true);  }
+
+ private:
+  Edge* _start;
+};
+
+inline FaceEdgeRange Face::edges(void) const { return FaceEdgeRange(_edge); }
+inline FaceVertRange Face::verts(void) const { return FaceVertRange(_edge); }
+
+inline VertEdgeRange Vert::edges     (void) const { return VertEdgeRange(_edge); }
+inline VertFaceRange Vert::faces     (void) const { return VertFaceRange(_edge); }
+inline VertVertRange Vert::neighbours(void) const { return VertVertRange(_edge); }
+
 #endif